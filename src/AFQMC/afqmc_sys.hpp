@@ -23,6 +23,7 @@
 #define  AFQMC_OPS_HPP 
 
 #include "Configuration.h"
+#include "Utilities/Clock.h"
 #include "Numerics/ma_lapack.hpp"
 #include "Numerics/ma_operations.hpp"
 #include "AFQMC/AFQMCInfo.hpp"
@@ -46,9 +47,9 @@ struct afqmc_sys: public AFQMCInfo
 
   public:
 
-    afqmc_sys() {}
+    afqmc_sys():walker_generation(0),dm_cache_hits(0),dm_cache_time_saved(0.0) {}
 
-    afqmc_sys(int nmo_, int na) 
+    afqmc_sys(int nmo_, int na):walker_generation(0),dm_cache_hits(0),dm_cache_time_saved(0.0)
     {
         setup(nmo_,na);
     }
@@ -90,38 +91,123 @@ struct afqmc_sys: public AFQMCInfo
       // temporary storage for contraction of density matrix with 2-electron integrals  
       Gcloc.resize(extents[1][1]); // force resize later 
 
+      invalidate_density_matrix();
     } 
 
+    /**
+     * Invalidates the cached mixed density matrix. 
+     * propagate and orthogonalize do this automatically, call it after any other 
+     * modification of the walkers or of the density matrix passed to calculate_mixed_density_matrix.
+     */
+    void invalidate_density_matrix()
+    {
+      walker_generation++;
+      dm_cache.valid = false;
+    }
+
+    /**
+     * True for a restricted closed shell trial wave function (trialwfn_alpha == trialwfn_beta). 
+     * Both spins of the walkers are then identical during the propagation and walker sets 
+     * with a single spin, W[nwalk][1][NMO][NAEA], can be used in all routines.
+     */
+    bool is_closed_shell() const
+    {
+      return trialwfn_alpha == trialwfn_beta;
+    }
+
+    // number of calls to calculate_mixed_density_matrix served from the cache 
+    long density_matrix_cache_hits() const { return dm_cache_hits; }
+    // estimated time saved by the cache, from the time of the cached evaluations 
+    double density_matrix_cache_time_saved() const { return dm_cache_time_saved; }
+
+    /**
+     * Calculates the mixed density matrix of the walkers, G[nspin_G*N*NMO][nwalk] with N=NAEA if compact, NMO otherwise.
+     * With closed shell walkers (W.shape()[1]==1), G can hold one spin (nspin_G=1) or both spins (nspin_G=2), 
+     * in which case the density matrix of the walker is copied to both spins.
+     */
     template< class WSet, 
               class Mat 
             >
     void calculate_mixed_density_matrix(const WSet& W, Mat& W_data, Mat& G, bool compact=true)
     {
       int nwalk = W.shape()[0];
-      assert(G.num_elements() >= 2*NAEA*NMO*nwalk);
+      int nspin = W.shape()[1];
+      int N_ = compact?NAEA:NMO;
+      int nspin_G = (nwalk==0)?nspin:G.num_elements()/(N_*NMO*nwalk);
+      assert(nspin_G == nspin || (nspin == 1 && nspin_G == 2));
       assert(W_data.shape()[0] >= nwalk);
       assert(W_data.shape()[1] >= 4);
-      int N_ = compact?NAEA:NMO;
+
+      // walkers and G are unchanged since the last evaluation 
+      if(density_matrix_is_cached(W,W_data,G,compact)) return;
+      double t0 = cpu_clock();
       boost::multi_array_ref<ComplexType,2> DM(TMat_MM.data(), extents[N_][NMO]); 
-      boost::multi_array_ref<ComplexType,4> G_4D(G.data(), extents[2][N_][NMO][nwalk]); 
+      boost::multi_array_ref<ComplexType,4> G_4D(G.data(), extents[nspin_G][N_][NMO][nwalk]); 
       for(int n=0; n<nwalk; n++) {
-        W_data[n][2] = base::MixedDensityMatrix<ComplexType>(trialwfn_alpha,W[n][0],
-                       DM,TMat_NN,TMat_NM,IWORK,WORK,compact);
+        W_data[n][2] = base::MixedDensityMatrix_LU<ComplexType>(trialwfn_alpha,W[n][0],
+                       DM,TMat_NN,TMat_NM,IWORK,compact);
         G_4D[ indices[0][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
 
-        W_data[n][3] = base::MixedDensityMatrix<ComplexType>(trialwfn_beta,W[n][1],
-                       DM,TMat_NN,TMat_NM,IWORK,WORK,compact);
-        G_4D[ indices[1][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
+        if(nspin == 2)
+          W_data[n][3] = base::MixedDensityMatrix_LU<ComplexType>(trialwfn_beta,W[n][1],
+                         DM,TMat_NN,TMat_NM,IWORK,compact);
+        else
+          W_data[n][3] = W_data[n][2];
+        if(nspin_G == 2)
+          G_4D[ indices[1][range_t(0,N_)][range_t(0,NMO)][n] ] = DM;
+      }
+
+      dm_cache.valid = true;
+      dm_cache.generation = walker_generation;
+      dm_cache.W = W.origin();
+      dm_cache.G = G.origin();
+      dm_cache.nwalk = nwalk;
+      dm_cache.nspin = W.shape()[1];
+      dm_cache.G_size = G.num_elements();
+      dm_cache.compact = compact;
+      dm_cache.ovlp.resize(2*nwalk);
+      for(int n=0; n<nwalk; n++) {
+        dm_cache.ovlp[2*n] = W_data[n][2];
+        dm_cache.ovlp[2*n+1] = W_data[n][3];
+      }
+      dm_cache.time = cpu_clock()-t0;
+    }
+
+    /**
+     * Returns true if G holds the mixed density matrix of the walkers in W, e.g. if they are 
+     * unchanged since the last call to calculate_mixed_density_matrix with the same arguments, 
+     * including the number of spins of W and the size of G. 
+     * In that case the overlaps in W_data are restored from the cached evaluation.
+     */
+    template< class WSet, 
+              class MatA, 
+              class MatB 
+            >
+    bool density_matrix_is_cached(const WSet& W, MatA& W_data, const MatB& G, bool compact=true)
+    {
+      int nwalk = W.shape()[0];
+      if(!dm_cache.valid || dm_cache.generation != walker_generation || dm_cache.W != W.origin() ||
+         dm_cache.G != G.origin() || dm_cache.nwalk != nwalk || dm_cache.nspin != int(W.shape()[1]) ||
+         dm_cache.G_size != G.num_elements() || dm_cache.compact != compact) 
+        return false;
+      for(int n=0; n<nwalk; n++) {
+        W_data[n][2] = dm_cache.ovlp[2*n];
+        W_data[n][3] = dm_cache.ovlp[2*n+1];
       }
+      dm_cache_hits++;
+      dm_cache_time_saved += dm_cache.time;
+      return true;
     }
 
     template<class SpMat,
-             class Mat
+             class MatA,
+             class MatB,
+             class MatC
             >
-    RealType calculate_energy(Mat& W_data, const Mat& G, const Mat& haj, const SpMat& V) 
+    RealType calculate_energy(MatA& W_data, const MatB& G, const MatC& haj, const SpMat& V) 
     {
       assert(G.shape()[0] == 2*NAEA*NMO);
-      if(G.shape()[1] != Gcloc.shape()[1])
+      if(G.shape()[0] != Gcloc.shape()[0] || G.shape()[1] != Gcloc.shape()[1])
         Gcloc.resize(extents[2*NMO*NAEA][G.shape()[1]]);  
       base::calculate_energy(W_data,G,Gcloc,haj,V);
       RealType eav = 0., wgt=0.;
@@ -139,42 +225,84 @@ struct afqmc_sys: public AFQMCInfo
       assert(W_data.shape()[1] >= 4);
       for(int n=0, nw=W.shape()[0]; n<nw; n++) {
         W_data[n][2] = base::Overlap<ComplexType>(trialwfn_alpha,W[n][0],TMat_NN,IWORK);
-        W_data[n][3] = base::Overlap<ComplexType>(trialwfn_beta,W[n][1],TMat_NN,IWORK);
+        if(W.shape()[1] == 2)
+          W_data[n][3] = base::Overlap<ComplexType>(trialwfn_beta,W[n][1],TMat_NN,IWORK);
+        else
+          W_data[n][3] = W_data[n][2];
       }
     }
 
+    /**
+     * Propagates the walkers: W(new) = Propg * exp(vHS) * Propg * W(old)
+     * vHS is [NMO*NMO][nwalk], or [nwalk][NMO*NMO] if walker_major==true (see get_vHS_walker_major).
+     * With walker_major==true, the exponentials of all walkers are applied together with apply_expM_batched,
+     * on the [NMO][nspin*NAEA] matrices that hold all the spins of a walker.
+     */
     template<class WSet, 
              class MatA,
              class MatB
             >
-    void propagate(WSet& W, const MatA& Propg, const MatB& vHS)
+    void propagate(WSet& W, const MatA& Propg, const MatB& vHS, bool walker_major=false)
     {
-      assert(vHS.shape()[0] == NMO*NMO);  
-      using Type = typename std::decay<MatB>::type::element;
-      boost::const_multi_array_ref<Type,3> V(vHS.data(), extents[NMO][NMO][vHS.shape()[1]]);
-      // re-interpretting matrices to avoid new temporary space  
-      boost::multi_array_ref<Type,2> T1(TMat_NM.data(), extents[NMO][NAEA]);
-      boost::multi_array_ref<Type,2> T2(TMat_MM2.data(), extents[NMO][NAEA]);
-      for(int nw=0, nwalk=W.shape()[0]; nw<nwalk; nw++) {
-
-        // need deep-copy, since stride()[1] == nw otherwise
-        TMat_MM = V[ indices[range_t(0,NMO)][range_t(0,NMO)][nw] ];
+      propagate(W,&Propg,Propg,vHS,walker_major);
+    }
 
-        ma::product(Propg,W[nw][0],TMat_MN);
-        base::apply_expM(TMat_MM,TMat_MN,T1,T2,6);
-        ma::product(Propg,TMat_MN,W[nw][0]);
+    /**
+     * Propagates the walkers with merged one-body half-steps: W(new) = exp(vHS) * Propg2 * W(old)
+     * With Propg2 = Propg * Propg, the walkers are kept half a step behind, W = Propg^{-1} * W(full step),
+     * and consecutive substeps only apply Propg2 once. Use split_half_step to recover the walkers 
+     * at the full step, e.g. for measurements.
+     */
+    template<class WSet, 
+             class MatA,
+             class MatB
+            >
+    void propagate_merged(WSet& W, const MatA& Propg2, const MatB& vHS, bool walker_major=false)
+    {
+      propagate(W,static_cast<const MatA*>(nullptr),Propg2,vHS,walker_major);
+    }
 
-        ma::product(Propg,W[nw][1],TMat_MN);
-        base::apply_expM(TMat_MM,TMat_MN,T1,T2,6);
-        ma::product(Propg,TMat_MN,W[nw][1]);
+    /**
+     * Applies the trailing one-body half-step to walkers propagated with propagate_merged: Wout = Propg * W
+     */
+    template<class WSet, 
+             class WSet2, 
+             class MatA
+            >
+    void split_half_step(const WSet& W, const MatA& Propg, WSet2& Wout)
+    {
+      assert(Wout.shape()[0] >= W.shape()[0]);
+      for(int nw=0, nwalk=W.shape()[0]; nw<nwalk; nw++) 
+        for(int s=0, nspin=W.shape()[1]; s<nspin; s++) 
+          ma::product(Propg,W[nw][s],Wout[nw][s]);
+    }
 
+    /**
+     * Removes the walkers with zero weight (W_data[n][1]) from the first nwalk walkers of W, 
+     * moving the live walkers, their data and their entries in id to a dense prefix, in order.
+     * Returns the number of live walkers.
+     */
+    template<class WSet, class Mat>
+    int compact_walkers(WSet& W, Mat& W_data, std::vector<int>& id, int nwalk)
+    {
+      int nlive = 0;
+      for(int n=0; n<nwalk; n++) {
+        if(W_data[n][1] == ComplexType(0.0)) continue;
+        if(n != nlive) {
+          W[nlive] = W[n];
+          W_data[nlive] = W_data[n];
+          id[nlive] = id[n];
+        }
+        nlive++;
       }
-
-    }    
+      if(nlive != nwalk) invalidate_density_matrix();
+      return nlive;
+    }
 
     template<class WSet>
     void orthogonalize(WSet& W)
     {
+      invalidate_density_matrix();
       for(int i=0; i<W.shape()[0]; i++) {
 
 /*
@@ -198,16 +326,72 @@ struct afqmc_sys: public AFQMCInfo
 */
 
         // LQ on the direct matrix
-        ma::gelqf(W[i][0],TAU,WORK);
-        ma::glq(W[i][0],TAU,WORK);
-        ma::gelqf(W[i][1],TAU,WORK);
-        ma::glq(W[i][1],TAU,WORK);
+        for(int s=0; s<W.shape()[1]; s++) {
+          ma::gelqf(W[i][s],TAU,WORK);
+          ma::glq(W[i][s],TAU,WORK);
+        }
 
       }
     }
 
   private:
 
+    // W(new) = PropgL * exp(vHS) * PropgR * W(old), PropgL is skipped if nullptr
+    template<class WSet, 
+             class MatA,
+             class MatB
+            >
+    void propagate(WSet& W, const MatA* PropgL, const MatA& PropgR, const MatB& vHS, bool walker_major)
+    {
+      assert(vHS.shape()[walker_major?1:0] == NMO*NMO);  
+      invalidate_density_matrix();
+      using Type = typename std::decay<MatB>::type::element;
+      // re-interpretting matrices to avoid new temporary space  
+      boost::multi_array_ref<Type,2> T1(TMat_NM.data(), extents[NMO][NAEA]);
+      boost::multi_array_ref<Type,2> T2(TMat_MM2.data(), extents[NMO][NAEA]);
+      int nwalk = W.shape()[0];
+      int nspin = W.shape()[1];
+
+      if(walker_major) {
+
+        if(TBatch_S.shape()[0] != nwalk || TBatch_S.shape()[2] != nspin*NAEA) {
+          TBatch_S.resize(extents[nwalk][NMO][nspin*NAEA]);
+          TBatch_1.resize(extents[nwalk][NMO][nspin*NAEA]);
+          TBatch_2.resize(extents[nwalk][NMO][nspin*NAEA]);
+        }
+        boost::const_multi_array_ref<Type,3> V(vHS.data(), extents[nwalk][NMO][NMO]);
+        for(int nw=0; nw<nwalk; nw++) 
+          for(int s=0; s<nspin; s++) 
+            ma::product(PropgR,W[nw][s],TBatch_S[nw][ indices[range_t(0,NMO)][range_t(s*NAEA,(s+1)*NAEA)] ]);
+        base::apply_expM_batched(V,TBatch_S,TBatch_1,TBatch_2,6);
+        for(int nw=0; nw<nwalk; nw++) 
+          for(int s=0; s<nspin; s++) {
+            if(PropgL != nullptr) 
+              ma::product(*PropgL,TBatch_S[nw][ indices[range_t(0,NMO)][range_t(s*NAEA,(s+1)*NAEA)] ],W[nw][s]);
+            else 
+              W[nw][s] = TBatch_S[nw][ indices[range_t(0,NMO)][range_t(s*NAEA,(s+1)*NAEA)] ];
+          }
+
+      } else {
+
+        boost::const_multi_array_ref<Type,3> V(vHS.data(), extents[NMO][NMO][vHS.shape()[1]]);
+        for(int nw=0; nw<nwalk; nw++) {
+          // need deep-copy, since stride()[1] == nw otherwise
+          TMat_MM = V[ indices[range_t(0,NMO)][range_t(0,NMO)][nw] ];
+          for(int s=0; s<nspin; s++) {
+            ma::product(PropgR,W[nw][s],TMat_MN);
+            base::apply_expM(TMat_MM,TMat_MN,T1,T2,6);
+            if(PropgL != nullptr) 
+              ma::product(*PropgL,TMat_MN,W[nw][s]);
+            else
+              W[nw][s] = TMat_MN;
+          }
+        }
+
+      }
+
+    }
+
     //! Buffers using std::vector
     //! Used in QR and invert
     std::vector<ComplexType> WORK; 
@@ -225,8 +409,34 @@ struct afqmc_sys: public AFQMCInfo
     ComplexMatrix TMat_MM;
     ComplexMatrix TMat_MM2;
 
+    //! Batches of [NMO][2*NAEA] matrices used in the propagation of walker blocks
+    boost::multi_array<ComplexType,3> TBatch_S;
+    boost::multi_array<ComplexType,3> TBatch_1;
+    boost::multi_array<ComplexType,3> TBatch_2;
+
     //! storage for contraction of 2-electron integrals with density matrix
     ComplexMatrix Gcloc;
+
+    //! cache of the last mixed density matrix evaluation
+    //! valid while the walkers are not modified, e.g. between the measurement 
+    //! at the end of a step and the first substep of the next one
+    struct DMCache {
+      DMCache():valid(false),generation(0),W(nullptr),G(nullptr),nwalk(0),nspin(0),G_size(0),compact(true),time(0.0) {}
+      bool valid;
+      unsigned long generation; 
+      const void* W;
+      const void* G;
+      int nwalk;
+      int nspin;
+      std::size_t G_size;
+      bool compact;
+      std::vector<ComplexType> ovlp;
+      double time;
+    } dm_cache;
+    //! incremented every time the walkers change 
+    unsigned long walker_generation;
+    long dm_cache_hits;
+    double dm_cache_time_saved;
 };
 
 }
@@ -0,0 +1,256 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file autotune.hpp
+ *  @brief Autotuning of the kernel configuration and persistent tuning database
+ *
+ *  The database is a text file with one line per machine and problem:
+ *
+ *     <machine signature> <problem signature> key=value key=value ...
+ *
+ *  Lines starting with # are ignored.
+ */
+
+#ifndef  AFQMC_AUTOTUNE_HPP
+#define  AFQMC_AUTOTUNE_HPP
+
+#include<string>
+#include<map>
+#include<vector>
+#include<fstream>
+#include<sstream>
+#include<iostream>
+#include<algorithm>
+#include "Configuration.h"
+#include "Message/OpenMP.h"
+#include "Utilities/Clock.h"
+#include "AFQMC/kernel_selection.hpp"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+/**
+ * Identifies the machine by its cpu model and the number of OpenMP threads.
+ */
+inline std::string machine_signature()
+{
+  std::string model = "unknown_cpu";
+  std::ifstream in("/proc/cpuinfo");
+  std::string line;
+  while(std::getline(in,line)) {
+    if(line.compare(0,10,"model name") == 0) {
+      std::size_t p = line.find(':');
+      if(p != std::string::npos) model = line.substr(line.find_first_not_of(" \t",p+1));
+      break;
+    }
+  }
+  std::replace(model.begin(),model.end(),' ','_');
+  std::replace(model.begin(),model.end(),'\t','_');
+  return model + "/omp" + std::to_string(omp_get_max_threads());
+}
+
+/**
+ * Identifies the problem by the dimensions that determine the cost of the kernels.
+ * The walker block size is not part of the signature, it is one of the tuned parameters.
+ */
+inline std::string problem_signature(int NMO, int NAEA, int nchol, unsigned long nnzSpvn, unsigned long nnzVakbl,
+                                     int nwalk, bool transposed)
+{
+  std::ostringstream out;
+  out<<"NMO" <<NMO <<"/NAEA" <<NAEA <<"/nchol" <<nchol <<"/nnzSpvn" <<nnzSpvn <<"/nnzVakbl" <<nnzVakbl
+     <<"/nwalk" <<nwalk <<"/t" <<transposed;
+  return out.str();
+}
+
+// persistent database of tuned parameters, keyed by machine and problem signature
+class TuningDatabase
+{
+  public:
+
+  typedef std::map<std::string,std::string> params_type;
+
+  // reads the database, returns false if the file can not be opened
+  bool load(const std::string& fname)
+  {
+    std::ifstream in(fname.c_str());
+    if(!in) return false;
+    std::string line;
+    while(std::getline(in,line)) {
+      if(line.empty() || line[0]=='#') continue;
+      std::istringstream is(line);
+      std::string machine, problem, kv;
+      if(!(is>>machine>>problem)) continue;
+      params_type& p = entries[{machine,problem}];
+      while(is>>kv) {
+        std::size_t eq = kv.find('=');
+        if(eq == std::string::npos) continue;
+        p[kv.substr(0,eq)] = kv.substr(eq+1);
+      }
+    }
+    return true;
+  }
+
+  bool save(const std::string& fname) const
+  {
+    std::ofstream out(fname.c_str());
+    if(!out) return false;
+    out<<"# miniafqmc tuning database: <machine> <problem> key=value ... \n";
+    for(auto& e: entries) {
+      out<<e.first.first <<" " <<e.first.second;
+      for(auto& kv: e.second)
+        out<<" " <<kv.first <<"=" <<kv.second;
+      out<<"\n";
+    }
+    return bool(out);
+  }
+
+  bool find(const std::string& machine, const std::string& problem, params_type& params) const
+  {
+    auto it = entries.find({machine,problem});
+    if(it == entries.end()) return false;
+    params = it->second;
+    return true;
+  }
+
+  // adds (or replaces) the parameters of a machine and problem
+  void store(const std::string& machine, const std::string& problem, const params_type& params)
+  {
+    params_type& p = entries[{machine,problem}];
+    for(auto& kv: params) p[kv.first] = kv.second;
+  }
+
+  private:
+
+  std::map<std::pair<std::string,std::string>,params_type> entries;
+
+};
+
+// storage format of a matrix, in the notation of the database: format:block
+struct TunedFormat
+{
+  std::string format;
+  int block;
+  double time;
+
+  std::string str() const { return format + ":" + std::to_string(block); }
+
+  static TunedFormat parse(const std::string& s)
+  {
+    TunedFormat f{s,1,0.0};
+    std::size_t p = s.find(':');
+    if(p != std::string::npos) {
+      f.format = s.substr(0,p);
+      f.block = std::max(1,atoi(s.substr(p+1).c_str()));
+    }
+    return f;
+  }
+};
+
+/**
+ * Times the products of A with a dense matrix of nwalk columns in every candidate storage format:
+ * csr, bsr and sell with several block sizes, dcsr and dense (if smaller than max_dense_memory bytes).
+ * If also_transposed==true, the product with T(A) is timed too.
+ * Formats with a fill below 10% are skipped. Returns the fastest format.
+ */
+template<class SpMat>
+inline TunedFormat tune_format(const SpMat& A, int nwalk, bool also_transposed, double max_dense_memory,
+                               int sigma, std::ostream& out, int nrep=10)
+{
+  using Type = typename SpMat::value_type;
+  using Mat = boost::multi_array<Type,2>;
+  const std::vector<TunedFormat> candidates = { {"csr",1,0.0}, {"bsr",2,0.0}, {"bsr",4,0.0}, {"bsr",8,0.0},
+                 {"sell",4,0.0}, {"sell",8,0.0}, {"sell",16,0.0}, {"dcsr",1,0.0}, {"dense",1,0.0} };
+
+  Mat B(extents[A.cols()][nwalk]);
+  Mat C(extents[A.rows()][nwalk]);
+  Mat BT(extents[also_transposed?A.rows():0][nwalk]);
+  Mat CT(extents[also_transposed?A.cols():0][nwalk]);
+  std::fill_n(B.data(),B.num_elements(),Type(1.0));
+  std::fill_n(BT.data(),BT.num_elements(),Type(1.0));
+
+  TunedFormat best{"csr",1,-1.0};
+  MatrixStorage<Type,typename SpMat::ptrType> S;
+  for(auto f: candidates) {
+    if(f.format == "dense" && double(A.rows())*double(A.cols())*sizeof(Type) > max_dense_memory) continue;
+    double fill = S.set_format(A,f.format,f.block,sigma);
+    if((f.format == "bsr" || f.format == "sell") && fill < 0.1) continue;
+    auto run = [&]() {
+      ma::product(S.op(),B,C);
+      if(also_transposed) ma::product(ma::T(S.op()),BT,CT);
+    };
+    run();
+    double t0 = cpu_clock();
+    for(int i=0; i<nrep; i++) run();
+    f.time = (cpu_clock()-t0)/nrep;
+    out<<"    " <<f.str() <<"  " <<f.time <<"\n";
+    if(best.time < 0.0 || f.time < best.time) best = f;
+  }
+  S.clear();
+  return best;
+}
+
+// walker block size and layout of the H-S potential, in the notation of the database:
+// walker_block=<size> vHS_layout=<walker|orbital>
+struct TunedPipeline
+{
+  int walker_block;
+  bool walker_major;
+  double time;
+
+  std::string layout() const { return walker_major?"walker":"orbital"; }
+};
+
+/**
+ * Times the propagation of nwalk walkers in blocks of walker_block walkers for every candidate
+ * block size (nwalk, nwalk/2, nwalk/4, ..., 1 and cache_block) and layout of the H-S potential.
+ * time_pass(walker_block,walker_major) propagates all the walkers once and returns the elapsed time,
+ * the first pass of every candidate is a warm-up. 
+ * The candidates are restricted to user_block if it is positive and to the layouts in layouts. 
+ * Returns the fastest configuration.
+ */
+template<class TimePass>
+inline TunedPipeline tune_pipeline(int nwalk, int cache_block, int user_block, const std::vector<bool>& layouts,
+                                   TimePass&& time_pass, std::ostream& out, int nrep=2)
+{
+  std::vector<int> blocks;
+  if(user_block > 0) 
+    blocks.push_back(user_block);
+  else {
+    for(int b=nwalk; b>=1; b/=2) blocks.push_back(b);
+    if(cache_block < nwalk && std::find(blocks.begin(),blocks.end(),cache_block) == blocks.end()) 
+      blocks.push_back(cache_block);
+  }
+
+  TunedPipeline best{nwalk,true,-1.0};
+  for(int b: blocks) 
+    for(bool walker_major: layouts) {
+      TunedPipeline p{b,walker_major,0.0};
+      time_pass(b,walker_major);
+      for(int i=0; i<nrep; i++) p.time += time_pass(b,walker_major);
+      p.time /= nrep;
+      out<<"    " <<p.walker_block <<":" <<p.layout() <<"  " <<p.time <<"\n";
+      if(best.time < 0.0 || p.time < best.time) best = p;
+    }
+  return best;
+}
+
+}
+
+}
+
+#endif
@@ -60,10 +60,13 @@ namespace base
  *
  * TODO: avoid use of multi_array_ref
  */
-template< class Mat,
+template< class MatA,
+          class MatB,
+          class MatC,
+          class MatD,
           class SpMat
         >
-inline void calculate_energy(Mat& W_data, const Mat& Gc, Mat& Gcloc, const Mat& haj, const SpMat& Vakbl)
+inline void calculate_energy(MatA& W_data, const MatB& Gc, MatC& Gcloc, const MatD& haj, const SpMat& Vakbl)
 {
   // W[nwalk][2][NMO][NAEA]
  
@@ -75,7 +78,7 @@ inline void calculate_energy(Mat& W_data, const Mat& Gc, Mat& Gcloc, const Mat&
   assert(Gc.shape()[0] == Vakbl.rows());
   assert(Gc.shape()[0] == Vakbl.cols());
 
-  using Type = typename std::decay<Mat>::type::element;
+  using Type = typename std::decay<MatA>::type::element;
 //  index_gen indices;
   Type zero = Type(0.);
   Type one = Type(1.); 
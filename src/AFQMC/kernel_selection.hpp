@@ -0,0 +1,225 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file kernel_selection.hpp
+ *  @brief Selection between sparse and dense storage of the Hamiltonian matrices
+ */
+
+#ifndef  AFQMC_KERNEL_SELECTION_HPP
+#define  AFQMC_KERNEL_SELECTION_HPP
+
+#include<algorithm>
+#include<cmath>
+#include<tuple>
+#include<vector>
+#include<unistd.h>
+#include "Configuration.h"
+#include "Utilities/Clock.h"
+#include "Numerics/ma_operations.hpp"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+/**
+ * Copies a compressed sparse matrix into dense storage.
+ */
+template<class SpMat, class Mat>
+inline void to_dense(const SpMat& A, Mat& M)
+{
+  assert(A.isCompressed());
+  using Type = typename Mat::element;
+  M.resize(extents[A.rows()][A.cols()]);
+  std::fill_n(M.data(),M.num_elements(),Type(0));
+  for(int r=0; r<A.rows(); r++) {
+    auto pv=A.val(*A.pntrb(r));
+    for(auto pc=A.indx(*A.pntrb(r)), pend=A.indx(*A.pntre(r)); pc!=pend; ++pc, ++pv)
+      M[r][*pc] = static_cast<Type>(*pv);
+  }
+}
+
+/**
+ * Stores in S the elements of the dense matrix M with absolute value larger than cut. 
+ * The diagonal is always stored. Returns the largest absolute value of the dropped elements,
+ * the Frobenius norm of the dropped elements is returned in err_fro.
+ */
+template<class Mat, class SpMat>
+inline double threshold_to_sparse(const Mat& M, double cut, SpMat& S, double& err_fro)
+{
+  int nr = M.shape()[0];
+  int nc = M.shape()[1];
+  double err_max = 0.0;
+  err_fro = 0.0;
+  S.setDims(nr,nc);
+  std::vector<std::tuple<int,int,typename SpMat::value_type>> v;
+  for(int i=0; i<nr; i++)
+    for(int j=0; j<nc; j++) {
+      double a = std::abs(M[i][j]);
+      if(i==j || a > cut) 
+        v.emplace_back(i,j,M[i][j]);
+      else {
+        err_max = std::max(err_max,a);
+        err_fro += a*a;
+      }
+    }
+  S.reserve(v.size());
+  S.add(v);
+  S.compress();
+  err_fro = std::sqrt(err_fro);
+  return err_max;
+}
+
+// storage of a sparse matrix in one of the formats of MatrixOperator, selected at runtime.
+// The csr matrix is not owned, other formats are built from it and the csr matrix is kept,
+// so they add to the memory of the csr matrix.
+template<class T, class PtrType=int>
+class MatrixStorage
+{
+  public:
+
+  typedef MatrixOperator<T,PtrType>  op_type;
+  typedef typename op_type::csr_type csr_type;
+
+  MatrixStorage():fmt("csr"),block(1),figure(1.0),A(nullptr) {}
+
+  /**
+   * Stores A in format f: csr, bsr, sell, dcsr or dense. b is the block size of bsr
+   * and the slice height of sell, rows of sell are sorted within windows of s*b rows.
+   * Returns the fill for bsr and sell, the bytes saved per non-zero against compact csr for dcsr, 1 otherwise.
+   */
+  double set_format(const csr_type& A_, const std::string& f, int b=1, int s=32)
+  {
+    clear();
+    A = &A_;
+    fmt = f;
+    block = b;
+    figure = 1.0;
+    if(f == "csr") {
+      Op = op_type(*A);
+    } else if(f == "bsr") {
+      figure = bsr.initFrom(*A,b);
+      Op = op_type(bsr);
+    } else if(f == "sell") {
+      figure = sell.initFrom(*A,b,s*b);
+      Op = op_type(sell);
+    } else if(f == "dcsr") {
+      figure = dcsr.initFrom(*A);
+      Op = op_type(dcsr);
+    } else if(f == "dense") {
+      to_dense(*A,dense);
+      Op = op_type(dense);
+    } else {
+      APP_ABORT(" Error: Unknown matrix format: " +f +"\n");
+    }
+    return figure;
+  }
+
+  // releases all formats except csr
+  void clear()
+  {
+    bsr.clear();
+    sell.clear();
+    dcsr.clear();
+    dense.resize(extents[0][0]);
+    fmt = "csr";
+    block = 1;
+    figure = 1.0;
+    if(A!=nullptr) Op = op_type(*A);
+  }
+
+  const op_type& op() const { return Op; }
+  const std::string& format() const { return fmt; }
+  int block_size() const { return block; }
+  double fill() const { return figure; }
+  // number of explicit zeros stored in dcsr format
+  long explicit_zeros() const { return (fmt=="dcsr")?long(dcsr.size())-long(A->size()):0; }
+
+  private:
+
+  std::string fmt;
+  int block;
+  double figure;
+  const csr_type* A;
+  op_type Op;
+  typename op_type::bsr_type bsr;
+  typename op_type::sell_type sell;
+  typename op_type::dcsr_type dcsr;
+  typename op_type::dense_type dense;
+
+};
+
+/**
+ * Returns the number of walkers whose data, of bytes_per_walker bytes each, fits in half of the 
+ * cache available to a core: the L2 cache or the share of the L3 cache per processor, whichever is larger.
+ */
+inline int cache_walker_block(double bytes_per_walker)
+{
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  long np = sysconf(_SC_NPROCESSORS_ONLN);
+  double cache = std::max(double(l2), (np > 0)?double(l3)/np:0.0);
+  if(cache <= 0.0) cache = 8.0*1024.0*1024.0;
+  return std::max(1,int(0.5*cache/bytes_per_walker));
+}
+
+/**
+ * Predicts the ratio between the time of the product of A with a dense matrix of nwalk columns
+ * with A in dense storage and the time with the current (sparse) storage of A.
+ * The sparse product is timed directly. The time of the dense product is estimated from its
+ * number of operations and the throughput of gemm, calibrated on a matrix of at most [512 x 512].
+ * A ratio smaller than 1 means that dense storage is predicted to be faster.
+ */
+template<class MatOp>
+inline double dense_to_sparse_time_ratio(const MatOp& A, int nwalk, int nrep=3)
+{
+  using Type = typename MatOp::value_type;
+  using Mat = boost::multi_array<Type,2>;
+  int nr = A.rows();
+  int nc = A.cols();
+  if(nr==0 || nc==0 || nwalk==0) return 1.0;
+
+  Mat B(extents[nc][nwalk]);
+  Mat C(extents[nr][nwalk]);
+  std::fill_n(B.data(),B.num_elements(),Type(1.0));
+  ma::product(A,B,C);
+  double t0 = cpu_clock();
+  for(int i=0; i<nrep; i++)
+    ma::product(A,B,C);
+  double tsparse = (cpu_clock()-t0)/nrep;
+
+  int m = std::min(nr,512);
+  int k = std::min(nc,512);
+  Mat Ad(extents[m][k]);
+  Mat Bd(extents[k][nwalk]);
+  Mat Cd(extents[m][nwalk]);
+  std::fill_n(Ad.data(),Ad.num_elements(),Type(1.0));
+  std::fill_n(Bd.data(),Bd.num_elements(),Type(1.0));
+  ma::product(Ad,Bd,Cd);
+  t0 = cpu_clock();
+  for(int i=0; i<nrep; i++)
+    ma::product(Ad,Bd,Cd);
+  double tgemm = (cpu_clock()-t0)/nrep;
+  double tdense = tgemm*(double(nr)/m)*(double(nc)/k);
+
+  return (tsparse > 0.0)?tdense/tsparse:1.0;
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file kernel_timing.hpp
+ *  @brief Repeated timing of a kernel, used by kernel_bench and afqmc_replay
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_KERNEL_TIMING_HPP
+#define QMCPLUSPLUS_AFQMC_KERNEL_TIMING_HPP
+
+#include<vector>
+#include<algorithm>
+#include<functional>
+#include "Utilities/Clock.h"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+// q-th quantile of the sorted times, with linear interpolation
+inline double quantile(const std::vector<double>& t, double q)
+{
+  if(t.size() == 0) return 0.0;
+  double x = q*(t.size()-1);
+  int i = std::min(int(x),int(t.size())-1);
+  int j = std::min(i+1,int(t.size())-1);
+  return t[i] + (x-i)*(t[j]-t[i]);
+}
+
+/**
+ * Times nrep calls of kernel after one warm-up call, returns the sorted times.
+ * setup is called before every call of kernel and is not timed.
+ */
+inline std::vector<double> time_kernel(const std::function<void()>& setup, const std::function<void()>& kernel,
+                                       int nrep)
+{
+  std::vector<double> t(nrep);
+  setup();
+  kernel();
+  for(int i=0; i<nrep; i++) {
+    setup();
+    double t0 = cpu_clock();
+    kernel();
+    t[i] = cpu_clock()-t0;
+  }
+  std::sort(t.begin(),t.end());
+  return t;
+}
+
+}
+
+}
+
+#endif
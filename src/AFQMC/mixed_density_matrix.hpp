@@ -104,6 +104,70 @@ inline Tp MixedDensityMatrix(const MatA& conjA, const MatB& B, MatC&& C, Mat&& T
 }
 
 
+/**
+ * Same as MixedDensityMatrix, but ( B^T * A^\dagger )^{-1} B^T is obtained from the LU factorization 
+ * of B^T * A^\dagger with triangular solves against B^T, without forming the inverse. 
+ * The overlap is the determinant of the same LU factorization, identical to the one of MixedDensityMatrix.
+ * No floating point work space is needed.
+ */
+// Serial Implementation
+template< class Tp,
+          class MatA,
+          class MatB,
+          class MatC,
+          class Mat,
+          class IBuffer
+        >
+inline Tp MixedDensityMatrix_LU(const MatA& conjA, const MatB& B, MatC&& C, Mat&& T1, Mat&& T2, IBuffer& IWORK, bool compact=true)
+{
+  // check dimensions are consistent
+  assert( conjA.shape()[0] == B.shape()[0] );
+  assert( conjA.shape()[1] == T1.shape()[1] );
+  assert( B.shape()[1] == T1.shape()[0] );
+  assert( T1.shape()[1] == B.shape()[1] );
+  assert( T2.shape()[0] == T1.shape()[0] );
+  if(compact) {
+    assert( C.shape()[0] == T1.shape()[0] );
+    assert( C.shape()[1] == B.shape()[0] );
+  } else {
+    assert( T2.shape()[1] == B.shape()[0] );
+    assert( C.shape()[0] == conjA.shape()[0] );
+    assert( C.shape()[1] == T2.shape()[1] );
+  }
+
+  using ma::T;
+
+  // T(B)*conj(A) 
+  ma::product(T(B),conjA,std::forward<Mat>(T1));  
+
+  // LU factorization of T1 and overlap 
+  ma::getrf(std::forward<Mat>(T1),IWORK);
+  Tp ovlp = static_cast<Tp>(ma::lu_determinant(T1,IWORK));
+
+  if(compact) {
+
+    // C = T1^(-1) * T(B)
+    for(int a=0, ae=B.shape()[1]; a<ae; a++)
+      for(int i=0, ie=B.shape()[0]; i<ie; i++)
+        C[a][i] = B[i][a];
+    ma::lu_solve(T1,IWORK,std::forward<MatC>(C));
+
+  } else {
+
+    // T2 = T1^(-1) * T(B)
+    for(int a=0, ae=B.shape()[1]; a<ae; a++)
+      for(int i=0, ie=B.shape()[0]; i<ie; i++)
+        T2[a][i] = B[i][a];
+    ma::lu_solve(T1,IWORK,std::forward<Mat>(T2));
+
+    // C = conj(A) * T2
+    ma::product(conjA,std::forward<Mat>(T2),std::forward<MatC>(C));
+
+  }
+
+  return ovlp;
+}
+
 /*
  * Returns the overlap of 2 Slater determinants:  <A|B> = det[ T(B) * conj(A) ]  
  * Parameters:
@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file roofline.hpp
+ *  @brief Analytical cost of the kernels and calibration of the machine peaks
+ *
+ *  Costs are counted in real floating point operations, a complex multiply-add counts as 8,
+ *  and in bytes of compulsory memory traffic: every operand is read once and every result
+ *  is written once. The costs are registered with the timers (NewTimer::add_work), which
+ *  report the achieved GFLOP/s and GB/s against the calibrated peaks.
+ */
+
+#ifndef  AFQMC_ROOFLINE_HPP
+#define  AFQMC_ROOFLINE_HPP
+
+#include<algorithm>
+#include<vector>
+#include<unistd.h>
+#include "Configuration.h"
+#include "Message/OpenMP.h"
+#include "Utilities/Clock.h"
+#include "Numerics/ma_operations.hpp"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+struct KernelCost
+{
+  double flops;
+  double bytes;
+
+  KernelCost& operator+=(const KernelCost& c)
+  {
+    flops += c.flops;
+    bytes += c.bytes;
+    return *this;
+  }
+};
+
+// bytes of the storage of A, assuming 4-byte column indices in the sparse formats
+template<class MatOp>
+inline double storage_bytes(const MatOp& A)
+{
+  using Type = typename MatOp::value_type;
+  return double(A.size())*(A.is_dense()?sizeof(Type):sizeof(Type)+sizeof(int));
+}
+
+/**
+ * Cost of C[nr][ncol] = A[nr][nc] * B[nc][ncol] (or T(A) * B) with A in any storage format.
+ */
+template<class MatOp>
+inline KernelCost product_cost(const MatOp& A, int ncol)
+{
+  using Type = typename MatOp::value_type;
+  return KernelCost{8.0*double(A.size())*ncol,
+                    storage_bytes(A) + double(A.rows()+A.cols())*ncol*sizeof(Type)};
+}
+
+/**
+ * Cost of the mixed density matrix of nwalk walkers with nspin spins: the overlap matrix,
+ * its LU factorization and the solve for the compact density matrix, and the
+ * product with the walker for the full density matrix.
+ */
+inline KernelCost density_matrix_cost(int NMO, int NAEA, int nspin, int nwalk, bool compact)
+{
+  double M = NMO, N = NAEA;
+  double flops = 8.0*M*N*N + 8.0*N*N*N/3.0 + 8.0*M*N*N + (compact?0.0:8.0*M*M*N);
+  double bytes = (M*N*(nwalk+1.0) + (compact?N:M)*M*nwalk)*sizeof(ComplexType);
+  return KernelCost{nspin*nwalk*flops, nspin*bytes};
+}
+
+// overlaps of nwalk walkers with the trial wave function: overlap matrix and its LU factorization
+inline KernelCost overlap_cost(int NMO, int NAEA, int nspin, int nwalk)
+{
+  double M = NMO, N = NAEA;
+  return KernelCost{nspin*nwalk*(8.0*M*N*N + 8.0*N*N*N/3.0),
+                    nspin*M*N*(nwalk+1.0)*sizeof(ComplexType)};
+}
+
+/**
+ * Cost of W(new) = PropgL * exp(vHS) * PropgR * W(old) for nwalk walkers with nspin spins,
+ * with exp(vHS) applied through a Taylor expansion of the given order.
+ * PropgL is skipped if nullptr.
+ */
+template<class MatOp>
+inline KernelCost propagation_cost(const MatOp* PropgL, const MatOp& PropgR, int NMO, int NAEA, int nspin,
+                                   int nwalk, int order=6)
+{
+  double M = NMO, N = NAEA;
+  KernelCost c{0.0,0.0};
+  c.flops = nspin*nwalk*(8.0*order*M*M*N + 8.0*double(PropgR.size())*N);
+  c.bytes = storage_bytes(PropgR) + M*M*nwalk*sizeof(ComplexType) + 2.0*nspin*nwalk*M*N*sizeof(ComplexType);
+  if(PropgL != nullptr) {
+    c.flops += nspin*nwalk*8.0*double(PropgL->size())*N;
+    c.bytes += storage_bytes(*PropgL);
+  }
+  return c;
+}
+
+// Householder QR factorization of the walkers and construction of the orthonormal factor
+inline KernelCost orthogonalization_cost(int NMO, int NAEA, int nspin, int nwalk)
+{
+  double M = NMO, N = NAEA;
+  return KernelCost{2.0*nspin*nwalk*4.0*(2.0*M*N*N - 2.0*N*N*N/3.0),
+                    2.0*nspin*nwalk*M*N*sizeof(ComplexType)};
+}
+
+// local energy from the compact density matrices Gc[NAK][nwalk]
+template<class MatOp>
+inline KernelCost energy_cost(const MatOp& Vakbl, int nwalk)
+{
+  KernelCost c = product_cost(Vakbl,nwalk);
+  c.flops += 16.0*Vakbl.rows()*nwalk;
+  c.bytes += double(Vakbl.rows())*sizeof(ComplexType);
+  return c;
+}
+
+/**
+ * Measures the throughput of complex gemm on [n x n] matrices, in GFLOP/s, from the fastest of nrep calls.
+ */
+inline double measure_gemm_peak(int n=512, int nrep=5)
+{
+  ComplexMatrix A(extents[n][n]);
+  ComplexMatrix B(extents[n][n]);
+  ComplexMatrix C(extents[n][n]);
+  std::fill_n(A.data(),A.num_elements(),ComplexType(1.0,0.5));
+  std::fill_n(B.data(),B.num_elements(),ComplexType(0.5,1.0));
+  ma::product(A,B,C);
+  double tmin = -1.0;
+  for(int i=0; i<nrep; i++) {
+    double t0 = cpu_clock();
+    ma::product(A,B,C);
+    double t = cpu_clock()-t0;
+    if(tmin < 0.0 || t < tmin) tmin = t;
+  }
+  return (tmin > 0.0)?8.0*double(n)*n*n/tmin/1e9:0.0;
+}
+
+/**
+ * Measures the memory bandwidth with the STREAM triad, a[i] = b[i] + s*c[i], in GB/s.
+ * Each array has n elements, by default 4 times the size of the last level cache (at least 4M elements).
+ * Following STREAM, 24 bytes are counted per element.
+ */
+inline double measure_stream_bandwidth(long n=0, int nrep=5)
+{
+  if(n <= 0) {
+    long llc = std::max(sysconf(_SC_LEVEL3_CACHE_SIZE),sysconf(_SC_LEVEL2_CACHE_SIZE));
+    n = std::max(4l*1024l*1024l, 4l*llc/long(sizeof(double)));
+  }
+  std::vector<double> a(n), b(n), c(n);
+  const double s = 3.0;
+#pragma omp parallel for
+  for(long i=0; i<n; i++) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+  double tmin = -1.0;
+  for(int r=0; r<nrep; r++) {
+    double t0 = cpu_clock();
+#pragma omp parallel for
+    for(long i=0; i<n; i++)
+      a[i] = b[i] + s*c[i];
+    double t = cpu_clock()-t0;
+    if(tmin < 0.0 || t < tmin) tmin = t;
+  }
+  return (tmin > 0.0)?3.0*sizeof(double)*double(n)/tmin/1e9:0.0;
+}
+
+}
+
+}
+
+#endif
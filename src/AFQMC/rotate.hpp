@@ -58,6 +58,10 @@ namespace base
  *  where M/N is the number of rows/columns of alpha and beta.
  *  The number of rows of Spvn should be equal to M*M.
  *
+ *  If closed_shell == true, alpha and beta must be equal and only 
+ *  B(ak,n) = 2 * \sum_i^M \alpha(i,a) * Spvn(ik,n) is stored, with N*M rows. 
+ *  The product with the density matrix of one spin then gives the contribution of both spins.
+ *
  *  Serial Implementation
  * 
  * \todo improve argument names
@@ -66,7 +70,7 @@ template< class Mat,
           class SpMatA,  
 	  class SpMatB	
         >
-inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, SpMatB& B, double cutoff=1e-6)
+inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, SpMatB& B, double cutoff=1e-6, bool closed_shell=false)
 {
   assert(Mat::dimensionality == 2); 
   int M = alpha.shape()[0]; 
@@ -79,7 +83,7 @@ inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, Sp
   auto zero = typename SpMatB::value_type(0);
   int nchol = A.cols();
 
-  B.setDims(A.cols(),2*N*M); 
+  B.setDims(A.cols(),(closed_shell?1:2)*N*M); 
 
   using Type = typename SpMatB::value_type;
 
@@ -118,6 +122,7 @@ inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, Sp
       for(int k=0; k<M; k++)
         if(std::abs(C[a][k]) > cutoff)  
           nz++;
+    if(closed_shell) continue;
 
     ma::product(T(beta),An,C);
     for(int a=0; a<N; a++)
@@ -126,7 +131,7 @@ inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, Sp
           nz++;
   }
 
-  B.resize(nz);
+  B.reserve(nz);
   // generate rotated matrix
    col = A.indx();
   val = A.val();
@@ -154,7 +159,8 @@ inline void halfrotate_cholesky(const Mat& alpha, const Mat& beta, SpMatA& A, Sp
     for(int a=0; a<N; a++)
       for(int k=0; k<M; k++)
         if(std::abs(C[a][k]) > cutoff)  
-          B.add(i,a*M+k,C[a][k]); 
+          B.add(i,a*M+k,(closed_shell?Type(2.0):Type(1.0))*C[a][k]); 
+    if(closed_shell) continue;
 
     ma::product(T(beta),An,C);
     for(int a=0; a<N; a++)
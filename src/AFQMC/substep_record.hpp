@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file substep_record.hpp
+ *  @brief Snapshot of the inputs and results of the stages of one substep of the miniapp
+ *
+ *  The miniapp records the walkers at the beginning of a substep and the result of every stage:
+ *  density matrix, bias potential, X, vHS, propagated walkers and their overlaps.
+ *  The Hamiltonian is not stored, only the input file or the synthetic Hamiltonian it was built from.
+ *  afqmc_replay reads the snapshot and re-runs the stages on exactly this data.
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_SUBSTEP_RECORD_HPP
+#define QMCPLUSPLUS_AFQMC_SUBSTEP_RECORD_HPP
+
+#include<string>
+#include<vector>
+
+#include "Configuration.h"
+#include "io/hdf_archive.h"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+struct SubstepRecord
+{
+  // configuration of the run
+  int step;
+  int substep;
+  int NMO;
+  int NAEA;
+  int nspin;
+  int nchol;
+  int nwalk;
+  bool transposed_Spvn;
+  bool walker_major_vHS;
+  bool merged_propg;
+  double propg_cutoff;         // cutoff of the sparse one-body propagators, negative if always dense
+  bool sparse_propg1;          // Propg1 was stored sparse, thresholded with propg_cutoff
+  bool sparse_propg2;          // Propg2 was stored sparse, thresholded with propg_cutoff
+  std::string init_file;
+  std::string synthetic_spec;  // empty if the Hamiltonian was read from init_file
+
+  // walkers at the beginning of the substep
+  WalkerContainer W;           // [nwalk][nspin][NMO][NAEA]
+  ComplexMatrix W_data;        // [nwalk][8]
+  // results of the stages
+  ComplexMatrix G;             // [nspin*NAEA*NMO][nwalk] (compact) with transposed_Spvn, [nspin*NMO*NMO][nwalk] otherwise
+  ComplexMatrix vbias;         // [nchol][nwalk]
+  ComplexMatrix X;             // [nchol][nwalk], including the bias
+  ComplexMatrix vHS;           // [nwalk][NMO*NMO] with walker_major_vHS, [NMO*NMO][nwalk] otherwise
+  WalkerContainer W_out;       // propagated walkers
+  ComplexMatrix W_data_out;    // with the overlaps of the propagated walkers
+
+  SubstepRecord():step(0),substep(0),NMO(0),NAEA(0),nspin(0),nchol(0),nwalk(0),
+                  transposed_Spvn(true),walker_major_vHS(true),merged_propg(false),
+                  propg_cutoff(-1.0),sparse_propg1(false),sparse_propg2(false) {}
+
+  void setup(int nmo, int naea, int ns, int nch, int nw, bool transposed, bool walker_major)
+  {
+    NMO = nmo;
+    NAEA = naea;
+    nspin = ns;
+    nchol = nch;
+    nwalk = nw;
+    transposed_Spvn = transposed;
+    walker_major_vHS = walker_major;
+    W.resize(extents[nwalk][nspin][NMO][NAEA]);
+    W_data.resize(extents[nwalk][8]);
+    G.resize(extents[nspin*(transposed?NAEA:NMO)*NMO][nwalk]);
+    vbias.resize(extents[nchol][nwalk]);
+    X.resize(extents[nchol][nwalk]);
+    vHS.resize(walker_major?extents[nwalk][NMO*NMO]:extents[NMO*NMO][nwalk]);
+    W_out.resize(extents[nwalk][nspin][NMO][NAEA]);
+    W_data_out.resize(extents[nwalk][8]);
+  }
+
+  // copies the columns of a block of walkers, B[n][0:nw], into the columns w0:w0+nw of A
+  template<class MatB>
+  static void copy_columns(const MatB& B, ComplexMatrix& A, int w0)
+  {
+    for(int i=0, iend=B.shape()[0]; i<iend; i++)
+      for(int n=0, nw=B.shape()[1]; n<nw; n++)
+        A[i][w0+n] = B[i][n];
+  }
+
+  // copies the rows of a block of walkers, B[0:nw][n], into the rows w0:w0+nw of A
+  template<class MatB>
+  static void copy_rows(const MatB& B, ComplexMatrix& A, int w0)
+  {
+    for(int n=0, nw=B.shape()[0]; n<nw; n++)
+      for(int i=0, iend=B.shape()[1]; i<iend; i++)
+        A[w0+n][i] = B[n][i];
+  }
+
+  bool write(const std::string& fname)
+  {
+    hdf_archive dump;
+    if(!dump.create(fname)) return false;
+    if(!dump.push("SubstepRecord")) return false;
+    std::vector<int> dims = {step, substep, NMO, NAEA, nspin, nchol, nwalk,
+                             int(transposed_Spvn), int(walker_major_vHS), int(merged_propg),
+                             int(synthetic_spec != ""), int(sparse_propg1), int(sparse_propg2)};
+    if(!dump.write(dims,"dims")) return false;
+    std::vector<double> cutoff(1,propg_cutoff);
+    if(!dump.write(cutoff,"propg_cutoff")) return false;
+    // hdf5 does not store empty strings, only the input of the Hamiltonian is written
+    std::string input = (synthetic_spec != "")?synthetic_spec:init_file;
+    if(!dump.write(input,"input")) return false;
+    std::vector<ComplexType> buf;
+    auto write_array = [&](const ComplexType* p, std::size_t n, const std::string& name) {
+      buf.assign(p,p+n);
+      return dump.write(buf,name);
+    };
+    if(!write_array(W.data(),W.num_elements(),"W")) return false;
+    if(!write_array(W_data.data(),W_data.num_elements(),"W_data")) return false;
+    if(!write_array(G.data(),G.num_elements(),"G")) return false;
+    if(!write_array(vbias.data(),vbias.num_elements(),"vbias")) return false;
+    if(!write_array(X.data(),X.num_elements(),"X")) return false;
+    if(!write_array(vHS.data(),vHS.num_elements(),"vHS")) return false;
+    if(!write_array(W_out.data(),W_out.num_elements(),"W_out")) return false;
+    if(!write_array(W_data_out.data(),W_data_out.num_elements(),"W_data_out")) return false;
+    dump.pop();
+    dump.close();
+    return true;
+  }
+
+  bool read(const std::string& fname)
+  {
+    hdf_archive dump;
+    if(!dump.open(fname,H5F_ACC_RDONLY)) return false;
+    if(!dump.push("SubstepRecord",false)) return false;
+    std::vector<int> dims;
+    if(!dump.read(dims,"dims") || dims.size() != 13) return false;
+    std::vector<double> cutoff;
+    if(!dump.read(cutoff,"propg_cutoff") || cutoff.size() != 1) return false;
+    propg_cutoff = cutoff[0];
+    std::string input;
+    if(!dump.read(input,"input")) return false;
+    init_file = dims[10]?std::string(""):input;
+    synthetic_spec = dims[10]?input:std::string("");
+    step = dims[0];
+    substep = dims[1];
+    merged_propg = bool(dims[9]);
+    sparse_propg1 = bool(dims[11]);
+    sparse_propg2 = bool(dims[12]);
+    setup(dims[2],dims[3],dims[4],dims[5],dims[6],bool(dims[7]),bool(dims[8]));
+    std::vector<ComplexType> buf;
+    auto read_array = [&](ComplexType* p, std::size_t n, const std::string& name) {
+      if(!dump.read(buf,name) || buf.size() != n) return false;
+      std::copy(buf.begin(),buf.end(),p);
+      return true;
+    };
+    if(!read_array(W.data(),W.num_elements(),"W")) return false;
+    if(!read_array(W_data.data(),W_data.num_elements(),"W_data")) return false;
+    if(!read_array(G.data(),G.num_elements(),"G")) return false;
+    if(!read_array(vbias.data(),vbias.num_elements(),"vbias")) return false;
+    if(!read_array(X.data(),X.num_elements(),"X")) return false;
+    if(!read_array(vHS.data(),vHS.num_elements(),"vHS")) return false;
+    if(!read_array(W_out.data(),W_out.num_elements(),"W_out")) return false;
+    if(!read_array(W_data_out.data(),W_data_out.num_elements(),"W_data_out")) return false;
+    dump.pop();
+    dump.close();
+    return true;
+  }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file telemetry.hpp
+ *  @brief Per-step telemetry of the miniapp, written as csv or JSON lines
+ *
+ *  One record is written and flushed at the end of every step, so that long runs can be
+ *  monitored while they execute. A record holds the time of the step and of every stage
+ *  during the step, the energy and statistics of the walker weights and overlaps.
+ *  Files ending in .json or .jsonl get one JSON object per line, other files get csv.
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_TELEMETRY_HPP
+#define QMCPLUSPLUS_AFQMC_TELEMETRY_HPP
+
+#include<string>
+#include<vector>
+#include<fstream>
+#include<cstdio>
+#include<cmath>
+#include<limits>
+
+#include "Configuration.h"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+struct WalkerStatistics
+{
+  double weight_sum;
+  double weight_std;   // standard deviation of the weights of all walkers, including those with zero weight
+  int nzero;           // number of walkers with zero weight
+  double ovlp_min;     // smallest and largest magnitude of the overlap with the trial wave function
+  double ovlp_max;
+};
+
+/**
+ * Statistics of the first nlive walkers in W_data, out of nwalk walkers.
+ * The walkers after nlive have been removed and count as walkers with zero weight.
+ * The overlap of a walker is the product of the overlaps of both spins, W_data[n][2]*W_data[n][3].
+ */
+template<class Mat>
+inline WalkerStatistics walker_statistics(const Mat& W_data, int nlive, int nwalk)
+{
+  WalkerStatistics s{0.0,0.0,nwalk-nlive,0.0,0.0};
+  double w2 = 0.0;
+  s.ovlp_min = std::numeric_limits<double>::max();
+  for(int n=0; n<nlive; n++) {
+    double w = W_data[n][1].real();
+    s.weight_sum += w;
+    w2 += w*w;
+    if(w == 0.0) s.nzero++;
+    double ovlp = std::abs(W_data[n][2]*W_data[n][3]);
+    s.ovlp_min = std::min(s.ovlp_min,ovlp);
+    s.ovlp_max = std::max(s.ovlp_max,ovlp);
+  }
+  if(nlive == 0) s.ovlp_min = 0.0;
+  if(nwalk > 0) {
+    double mean = s.weight_sum/nwalk;
+    s.weight_std = std::sqrt(std::max(0.0,w2/nwalk-mean*mean));
+  }
+  return s;
+}
+
+class TelemetryStream
+{
+  public:
+
+  TelemetryStream():json(false) {}
+
+  /**
+   * Opens fname, truncating it, for records with the times of the given stages.
+   * Returns false on errors.
+   */
+  bool open(const std::string& fname, const std::vector<std::string>& stages)
+  {
+    stage_names = stages;
+    std::string::size_type dot = fname.find_last_of('.');
+    std::string ext = (dot == std::string::npos)?std::string(""):fname.substr(dot);
+    json = (ext == ".json" || ext == ".jsonl");
+    out.open(fname.c_str(),std::ios::out | std::ios::trunc);
+    if(!out) return false;
+    if(!json) {
+      out<<"step,elapsed,step_time,energy,weight_sum,weight_std,zero_weight,ovlp_min,ovlp_max";
+      for(int i=0; i<stage_names.size(); i++)
+        out<<"," <<stage_names[i];
+      out<<"\n";
+      out.flush();
+    }
+    return bool(out);
+  }
+
+  bool is_open() const { return out.is_open(); }
+
+  /**
+   * Writes the record of a step: the time since the start of the run, the time of the step,
+   * and the time of every stage during the step, in the order of the stage names given to open.
+   */
+  void write(int step, double elapsed, double step_time, double energy, const WalkerStatistics& s,
+             const std::vector<double>& stage_times)
+  {
+    char buf[256];
+    if(json) {
+      snprintf(buf, sizeof(buf),
+               "{\"step\":%d,\"elapsed\":%.6f,\"step_time\":%.6e,\"energy\":%.10g,\"weight_sum\":%.10g,"
+               "\"weight_std\":%.6g,\"zero_weight\":%d,\"ovlp_min\":%.6e,\"ovlp_max\":%.6e,\"stages\":{",
+               step, elapsed, step_time, energy, s.weight_sum, s.weight_std, s.nzero, s.ovlp_min, s.ovlp_max);
+      out<<buf;
+      for(int i=0; i<stage_names.size(); i++) {
+        snprintf(buf, sizeof(buf), "%.6e", stage_times[i]);
+        out<<(i>0?",":"") <<"\"" <<stage_names[i] <<"\":" <<buf;
+      }
+      out<<"}}\n";
+    } else {
+      snprintf(buf, sizeof(buf), "%d,%.6f,%.6e,%.10g,%.10g,%.6g,%d,%.6e,%.6e",
+               step, elapsed, step_time, energy, s.weight_sum, s.weight_std, s.nzero, s.ovlp_min, s.ovlp_max);
+      out<<buf;
+      for(int i=0; i<stage_names.size(); i++) {
+        snprintf(buf, sizeof(buf), ",%.6e", stage_times[i]);
+        out<<buf;
+      }
+      out<<"\n";
+    }
+    out.flush();
+  }
+
+  private:
+
+  bool json;
+  std::ofstream out;
+  std::vector<std::string> stage_names;
+
+};
+
+}
+
+}
+
+#endif
@@ -24,7 +24,9 @@
 
 #include "Numerics/ma_operations.hpp"
 #include "Numerics/OhmmsBlas.h"
+#include "Matrix/MatrixOperator.hpp"
 #include<iostream>
+#include<algorithm>
 
 namespace qmcplusplus
 {
@@ -55,6 +57,138 @@ inline void get_vHS(const SpMat& Spvn, const MatA& X, MatB&& v)
   ma::product(Spvn,X,std::forward<MatB>(v));  
 }
 
+// copies the transpose of the first nr rows of T into columns [r0,r0+nr) of v: v(w,r0+r) = T(r,w) 
+template<class MatA, class MatB>
+inline void transpose_block(const MatA& T, int r0, int nr, MatB&& v)
+{
+  int nw = T.shape()[1];
+  for(int w=0; w<nw; w++) {
+    auto vw = v[w].origin()+r0;
+    for(int r=0; r<nr; r++)
+      vw[r] = T[r][w];
+  }
+}
+
+// number of rows of the blocks in the walker-major products, the block of vHS is ~32KB 
+inline int vHS_row_block(int nw)
+{
+  return std::max(16,2048/std::max(1,nw));
+}
+
+/**
+ * Calculates the H-S potential in walker-major layout, for propagation without strided copies: 
+ * \f$ vHS = (Spvn * X)^T  \f$
+ *
+ * \f$    vHS(w,ik) = \sum_n Spvn(ik,n) * X(n,w) \f$
+ *
+ * csr and dcsr matrices are multiplied in blocks of rows, each block is transposed while in cache.
+ * Dense matrices use a single gemm. 
+ * Other formats compute Spvn*X in a temporary array and transpose it.
+ *
+ * Serial Implementation
+ */
+template< class SpMat,
+	  class MatA,	
+	  class MatB	
+        >
+inline void get_vHS_walker_major(const SpMat& Spvn, const MatA& X, MatB&& v)
+{
+  assert( Spvn.cols() == X.shape()[0] );
+  assert( Spvn.rows() == v.shape()[1] );
+  assert( X.shape()[1] == v.shape()[0] );
+
+  using Type = typename std::decay<MatB>::type::element;
+  int nr = Spvn.rows(), nw = X.shape()[1];
+  boost::multi_array<Type,2> T1(extents[nr][nw]);
+  ma::product(Spvn,X,T1);  
+  transpose_block(T1,0,nr,v);
+}
+
+template< class T,
+          class P,
+	  class MatA,	
+	  class MatB	
+        >
+inline void get_vHS_walker_major(const SparseMatrix<T,P>& Spvn, const MatA& X, MatB&& v)
+{
+  assert( Spvn.cols() == X.shape()[0] );
+  assert( Spvn.rows() == v.shape()[1] );
+  assert( X.shape()[1] == v.shape()[0] );
+  assert( X.strides()[1] == 1 );
+
+  int nr = Spvn.rows(), nw = X.shape()[1], rb = vHS_row_block(nw);
+  boost::multi_array<T,2> T1(extents[rb][nw]);
+  for(int r0=0; r0<nr; r0+=rb) {
+    int nb = std::min(rb,nr-r0);
+    auto p0 = *Spvn.pntrb(r0);
+    SPBLAS::csrmm('N', nb, nw, Spvn.cols(), T(1.0), "GxxCxx", 
+        Spvn.val(p0), Spvn.indx(p0), Spvn.pntrb(r0), Spvn.pntre(r0), 
+        X.origin(), X.strides()[0], T(0.0), T1.origin(), nw);
+    transpose_block(T1,r0,nb,v);
+  }
+}
+
+template< class T,
+	  class MatA,	
+	  class MatB	
+        >
+inline void get_vHS_walker_major(const DeltaSparseMatrix<T>& Spvn, const MatA& X, MatB&& v)
+{
+  assert( Spvn.cols() == X.shape()[0] );
+  assert( Spvn.rows() == v.shape()[1] );
+  assert( X.shape()[1] == v.shape()[0] );
+  assert( X.strides()[1] == 1 );
+
+  int nr = Spvn.rows(), nw = X.shape()[1], rb = vHS_row_block(nw);
+  boost::multi_array<T,2> T1(extents[rb][nw]);
+  for(int r0=0; r0<nr; r0+=rb) {
+    int nb = std::min(rb,nr-r0);
+    int p0 = *Spvn.pntrb(r0);
+    mySPBLAS::dcsrmm('N', nb, nw, Spvn.cols(), T(1.0), 
+        Spvn.val(p0), Spvn.delta(p0), Spvn.base(r0), Spvn.pntrb(r0), Spvn.pntre(r0), 
+        X.origin(), X.strides()[0], T(0.0), T1.origin(), nw);
+    transpose_block(T1,r0,nb,v);
+  }
+}
+
+template< class T,
+	  class MatA,	
+	  class MatB	
+        >
+inline void get_vHS_walker_major(const boost::multi_array<T,2>& Spvn, const MatA& X, MatB&& v)
+{
+  assert( Spvn.shape()[1] == X.shape()[0] );
+  assert( Spvn.shape()[0] == v.shape()[1] );
+  assert( X.shape()[1] == v.shape()[0] );
+
+  // vHS = T(X)*T(Spvn)
+  ma::product(ma::T(X),ma::T(Spvn),std::forward<MatB>(v));  
+}
+
+// dispatches to the storage format referenced by a MatrixOperator
+template<class MatA, class MatB>
+struct vHS_walker_major_visitor
+{
+  typedef void result_type;
+  const MatA& X;
+  MatB& v;
+  vHS_walker_major_visitor(const MatA& X_, MatB& v_):X(X_),v(v_) {}
+  template<class SpMat> void operator()(const SpMat* Spvn) const
+  {
+    get_vHS_walker_major(*Spvn,X,v);
+  }
+};
+
+template< class T,
+          class P,
+	  class MatA,	
+	  class MatB	
+        >
+inline void get_vHS_walker_major(const MatrixOperator<T,P>& Spvn, const MatA& X, MatB&& v)
+{
+  Spvn.apply( vHS_walker_major_visitor<MatA,typename std::decay<MatB>::type>(X,v) );
+}
+
 /**
  * Calculate \f$S = \exp(V)*S \f$ using a Taylor expansion of exp(V)
  */ 
@@ -90,6 +224,52 @@ inline void apply_expM( const MatA& V, MatB&& S, MatC&& T1, MatC&& T2, int order
 
 }
 
+/**
+ * Calculate \f$S[i] = \exp(V[i])*S[i] \f$ for a batch of matrices, using a Taylor expansion of exp(V)
+ * evaluated in Horner form: R = S + (i/n)*V*R, for n = order...1, starting from R = S.
+ * Every step but the last copies S into the output buffer and adds (i/n)*V*R to it through beta=1
+ * of the batched gemm, the last step adds directly to S. One copy of S per order remains.
+ * V: [nbatch][M][M], S, T1, T2: [nbatch][M][N]. S, T1 and T2 must be contiguous. 
+ */ 
+template< class MatA,
+          class MatB,
+          class MatC
+        >
+inline void apply_expM_batched( const MatA& V, MatB&& S, MatC&& T1, MatC&& T2, int order=6)
+{ 
+  assert( V.shape()[0] == S.shape()[0] );
+  assert( V.shape()[1] == V.shape()[2] );
+  assert( V.shape()[2] == S.shape()[1] );
+  assert( S.num_elements() == T1.num_elements() );
+  assert( S.num_elements() == T2.num_elements() );
+
+  using ComplexType = typename std::decay<MatB>::type::element; 
+  const ComplexType one(1.);
+  using ptr_type = typename std::decay<MatC>::type*;
+  ptr_type pin = nullptr; 
+  ptr_type pout = &T1; 
+
+  for(int n=order; n>=1; n--) {
+    ComplexType fact = ComplexType(0.0,1.0)*static_cast<ComplexType>(1.0/static_cast<double>(n));
+    if(n==1) {
+      if(pin == nullptr) {
+        std::copy_n(S.data(),S.num_elements(),T1.data());
+        pin = &T1;
+      }
+      ma::gemm_batched<'N','N'>(fact,*pin,V,one,S);
+      break;
+    }
+    std::copy_n(S.data(),S.num_elements(),pout->data());
+    if(pin == nullptr)
+      ma::gemm_batched<'N','N'>(fact,S,V,one,*pout);
+    else
+      ma::gemm_batched<'N','N'>(fact,*pin,V,one,*pout);
+    pin = pout;
+    pout = (pout == &T1)?&T2:&T1;
+  }
+
+}
+
 }
 
 }
@@ -37,6 +37,9 @@ namespace base
  *
  *  \f$ vbias(n,w) = \sum_{ik} Spvn(ik,n)  G(ik,w) \f$
  * 
+ *  If transposed==false, G holds the density matrix of both spins or, for closed shell walkers, 
+ *  of a single spin, which then contributes twice. 
+ * 
  * Serial Implementation
  * \todo improve template and argument names
  *
@@ -65,12 +68,18 @@ inline void get_vbias(const SpMat& Spvn, const MatA& G, MatB&& v, bool transpose
   } else {
 
     assert( MatA::dimensionality == 2);
-    assert( Spvn.rows()*2 == G.shape()[0] );
+    assert( Spvn.rows()*2 == G.shape()[0] || Spvn.rows() == G.shape()[0] );
     assert( Spvn.cols() == v.shape()[0] );
     assert( G.shape()[1] == v.shape()[1] );
 
     using ma::T;
 
+    // closed shell
+    if(Spvn.rows() == G.shape()[0]) {
+      ma::product(TypeA(2.), T(Spvn), G, TypeA(0.), std::forward<MatB>(v));
+      return;
+    }
+
     // alpha
     ma::product(
     	T(Spvn), G[indices[range_t() < range_t::index(G.shape()[0]/2)][range_t()]], std::forward<MatB>(v)
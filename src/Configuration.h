@@ -53,6 +53,10 @@
 #include<boost/multi_array.hpp>
 
 #include "Matrix/SparseMatrix.hpp"
+#include "Matrix/BlockSparseMatrix.hpp"
+#include "Matrix/SlicedEllMatrix.hpp"
+#include "Matrix/DeltaSparseMatrix.hpp"
+#include "Matrix/MatrixOperator.hpp"
 
 namespace qmcplusplus
 {
@@ -64,6 +68,7 @@ namespace qmcplusplus
 
   typedef OHMMS_INDEXTYPE                 IndexType;
   typedef OHMMS_INDEXTYPE                 OrbitalType;
+  typedef AFQMC_SPARSE_PTRTYPE            SpPtrType;
   typedef OHMMS_PRECISION_FULL            RealType;
   typedef OHMMS_PRECISION                 SPRealType;
 
@@ -106,11 +111,23 @@ namespace qmcplusplus
   typedef boost::multi_array<ComplexType,2> ComplexMatrix;  
   typedef boost::multi_array<SPComplexType,2> SPComplexMatrix;  
 
-  typedef SparseMatrix<IndexType>     IndexSpMat;
-  typedef SparseMatrix<RealType>      RealSpMat;
-  typedef SparseMatrix<ValueType>     ValueSpMat;
-  typedef SparseMatrix<SPValueType>   SPValueSpMat;
-  typedef SparseMatrix<ComplexType>   ComplexSpMat;
+  typedef SparseMatrix<IndexType,SpPtrType>     IndexSpMat;
+  typedef SparseMatrix<RealType,SpPtrType>      RealSpMat;
+  typedef SparseMatrix<ValueType,SpPtrType>     ValueSpMat;
+  typedef SparseMatrix<SPValueType,SpPtrType>   SPValueSpMat;
+  typedef SparseMatrix<ComplexType,SpPtrType>   ComplexSpMat;
+
+  typedef BlockSparseMatrix<ValueType>     ValueBSpMat;
+  typedef BlockSparseMatrix<ComplexType>   ComplexBSpMat;
+
+  typedef SlicedEllMatrix<ValueType>     ValueSellSpMat;
+  typedef SlicedEllMatrix<ComplexType>   ComplexSellSpMat;
+
+  typedef DeltaSparseMatrix<ValueType>     ValueDeltaSpMat;
+  typedef DeltaSparseMatrix<ComplexType>   ComplexDeltaSpMat;
+
+  typedef MatrixOperator<ValueType,SpPtrType>     ValueMatOp;
+  typedef MatrixOperator<ComplexType,SpPtrType>   ComplexMatOp;
 /*
   typedef SMSparseMatrix<IndexType>     IndexSMSpMat;
   typedef SMSparseMatrix<RealType>      RealSMSpMat;
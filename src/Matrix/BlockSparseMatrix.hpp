@@ -0,0 +1,227 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef QMCPLUSPLUS_AFQMC_BLOCKSPARSEMATRIX_H
+#define QMCPLUSPLUS_AFQMC_BLOCKSPARSEMATRIX_H
+
+#include<iostream>
+#include<vector>
+#include<limits>
+#include<assert.h>
+#include<algorithm>
+
+namespace qmcplusplus
+{
+
+// class that implements a sparse matrix in block-CSR (BSR) format with square blocks
+// of dimension [bs x bs]. Blocks are stored contiguously in row-major order.
+// Blocks on the last block row/column are padded with zeros if the dimensions of the
+// matrix are not a multiple of the block size.
+template<class T>
+class BlockSparseMatrix
+{
+  public:
+
+  typedef T            Type_t;
+  typedef T            value_type;
+  typedef T*           pointer;
+  typedef const T*     const_pointer;
+  typedef const int*   const_intPtr;
+  typedef int          intType;
+  typedef int*         intPtr;
+  typedef BlockSparseMatrix<T>  This_t;
+
+  // -3: block sparse matrix, see ma::product
+  const static int dimensionality = -3;
+  const static bool sparse = true;
+
+  BlockSparseMatrix<T>():nr(0),nc(0),bs(1),nnz(0),vals(),bcolms(),browIndex()
+  {
+  }
+
+  ~BlockSparseMatrix<T>()
+  {
+  }
+
+  BlockSparseMatrix<T>(const BlockSparseMatrix<T> &rhs) = delete;
+  This_t& operator=(const BlockSparseMatrix<T> &rhs) = delete;
+
+  void clear() {
+    vals.clear();
+    bcolms.clear();
+    browIndex.clear();
+    nr=nc=nnz=0;
+    bs=1;
+  }
+
+  /**
+   * Builds the block representation of a compressed CSR matrix with blocks of dimension [b x b].
+   * Returns the block fill, e.g. the fraction of stored values that are non-zero in A.
+   */
+  template<class SpMat>
+  double initFrom(const SpMat& A, int b)
+  {
+    assert(A.isCompressed());
+    assert(b > 0);
+    clear();
+    nr = A.rows();
+    nc = A.cols();
+    bs = b;
+    nnz = A.size();
+    int nbr = (nr+bs-1)/bs;
+    int nbc = (nc+bs-1)/bs;
+    int bs2 = bs*bs;
+
+    // position of block column J in the current block row, -1 if not present
+    std::vector<int> loc(nbc,-1);
+    std::vector<int> cols;
+    browIndex.resize(nbr+1);
+    browIndex[0]=0;
+    for(int I=0; I<nbr; I++) {
+
+      // find the block columns with non-zero terms
+      cols.clear();
+      for(int r=I*bs, rend=std::min(nr,(I+1)*bs); r<rend; r++)
+        for(auto pc=A.indx(*A.pntrb(r)), pend=A.indx(*A.pntre(r)); pc!=pend; ++pc) {
+          int J = (*pc)/bs;
+          if(loc[J] < 0) {
+            loc[J] = 0;
+            cols.push_back(J);
+          }
+        }
+      std::sort(cols.begin(),cols.end());
+
+      int b0 = bcolms.size();
+      for(int n=0; n<cols.size(); n++) {
+        loc[cols[n]] = b0+n;
+        bcolms.push_back(cols[n]);
+      }
+      vals.resize(bcolms.size()*bs2,T(0));
+
+      // copy values into blocks
+      for(int r=I*bs, rend=std::min(nr,(I+1)*bs); r<rend; r++) {
+        auto pv=A.val(*A.pntrb(r));
+        for(auto pc=A.indx(*A.pntrb(r)), pend=A.indx(*A.pntre(r)); pc!=pend; ++pc, ++pv)
+          vals[ loc[(*pc)/bs]*bs2 + (r-I*bs)*bs + (*pc)%bs ] += *pv;
+      }
+
+      for(int n=0; n<cols.size(); n++) loc[cols[n]] = -1;
+      browIndex[I+1] = bcolms.size();
+    }
+
+    // indexed with int
+    assert(vals.size() < static_cast<unsigned long>(std::numeric_limits<intType>::max()));
+    return fill();
+  }
+
+  // fraction of stored values that are non-zero in the original matrix
+  double fill() const
+  {
+    return (vals.size()==0)?0.0:double(nnz)/double(vals.size());
+  }
+
+  // number of stored values, including padding
+  unsigned long size() const
+  {
+    return vals.size();
+  }
+  // number of non-zero elements in the original matrix
+  unsigned long num_non_zero_elements() const
+  {
+    return nnz;
+  }
+  unsigned long num_blocks() const
+  {
+    return bcolms.size();
+  }
+  int rows() const
+  {
+    return nr;
+  }
+  int cols() const
+  {
+    return nc;
+  }
+  int block_size() const
+  {
+    return bs;
+  }
+  int block_rows() const
+  {
+    return (nr+bs-1)/bs;
+  }
+  int block_cols() const
+  {
+    return (nc+bs-1)/bs;
+  }
+
+  // memory footprint in bytes
+  unsigned long memory() const
+  {
+    return vals.size()*sizeof(T) + (bcolms.size()+browIndex.size())*sizeof(intType);
+  }
+
+  // ******************************************
+  // access functions according to MKL notation
+  const_pointer val(long n=0) const
+  {
+    return vals.data()+n;
+  }
+  pointer val(long n=0)
+  {
+    return vals.data()+n;
+  }
+
+  const_intPtr indx(long n=0) const
+  {
+    return bcolms.data()+n;
+  }
+  intPtr indx(long n=0)
+  {
+    return bcolms.data()+n;
+  }
+
+  const_intPtr pntrb(long n=0) const
+  {
+    return browIndex.data()+n;
+  }
+  intPtr pntrb(long n=0)
+  {
+    return browIndex.data()+n;
+  }
+
+  const_intPtr pntre(long n=0) const
+  {
+    return browIndex.data()+n+1;
+  }
+  intPtr pntre(long n=0)
+  {
+    return browIndex.data()+n+1;
+  }
+  // ******************************************
+
+  private:
+
+  int nr,nc;
+  int bs;
+  unsigned long nnz;
+  std::vector<T> vals;
+  std::vector<intType> bcolms,browIndex;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,185 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef QMCPLUSPLUS_AFQMC_DELTASPARSEMATRIX_H
+#define QMCPLUSPLUS_AFQMC_DELTASPARSEMATRIX_H
+
+#include<iostream>
+#include<vector>
+#include<assert.h>
+#include<cstdint>
+#include<limits>
+
+namespace qmcplusplus
+{
+
+// class that implements a sparse matrix in CSR format with compressed column indices.
+// The column of the first element of each row is stored in a per-row base,
+// every other element stores the (16-bit) distance to the column of the previous element.
+// Gaps larger than 65535 columns are bridged with explicit zeros.
+// There is no COO row array.
+template<class T>
+class DeltaSparseMatrix
+{
+  public:
+
+  typedef T            Type_t;
+  typedef T            value_type;
+  typedef T*           pointer;
+  typedef const T*     const_pointer;
+  typedef const int*   const_intPtr;
+  typedef int          intType;
+  typedef int*         intPtr;
+  typedef uint16_t     deltaType;
+  typedef const uint16_t* const_deltaPtr;
+  typedef DeltaSparseMatrix<T>  This_t;
+
+  // -5: sparse matrix with compressed indices, see ma::product
+  const static int dimensionality = -5;
+  const static bool sparse = true;
+
+  DeltaSparseMatrix<T>():nr(0),nc(0),nnz(0),vals(),deltas(),rowBase(),rowIndex()
+  {
+  }
+
+  ~DeltaSparseMatrix<T>()
+  {
+  }
+
+  DeltaSparseMatrix<T>(const DeltaSparseMatrix<T> &rhs) = delete;
+  This_t& operator=(const DeltaSparseMatrix<T> &rhs) = delete;
+
+  void clear() {
+    vals.clear();
+    deltas.clear();
+    rowBase.clear();
+    rowIndex.clear();
+    nr=nc=nnz=0;
+  }
+
+  /**
+   * Builds the compressed representation of a compressed CSR matrix.
+   * Returns the number of bytes saved per non-zero element with respect to A in compact
+   * CSR form (values, columns and row index), the arrays read by the CSR kernels.
+   */
+  template<class SpMat>
+  double initFrom(const SpMat& A)
+  {
+    assert(A.isCompressed());
+    clear();
+    nr = A.rows();
+    nc = A.cols();
+    nnz = A.size();
+    const int maxd = std::numeric_limits<deltaType>::max();
+
+    vals.reserve(nnz);
+    deltas.reserve(nnz);
+    rowBase.resize(nr);
+    rowIndex.resize(nr+1);
+    rowIndex[0]=0;
+    for(int r=0; r<nr; r++) {
+      auto pv=A.val(*A.pntrb(r));
+      auto pc=A.indx(*A.pntrb(r));
+      auto pend=A.indx(*A.pntre(r));
+      rowBase[r] = (pc!=pend)?(*pc):0;
+      int prev = rowBase[r];
+      for(; pc!=pend; ++pc, ++pv) {
+        assert(*pc >= prev);
+        while(*pc-prev > maxd) {
+          prev += maxd;
+          vals.push_back(T(0));
+          deltas.push_back(deltaType(maxd));
+        }
+        vals.push_back(*pv);
+        deltas.push_back(deltaType(*pc-prev));
+        prev = *pc;
+      }
+      rowIndex[r+1] = vals.size();
+    }
+
+    // indexed with int
+    assert(vals.size() < static_cast<unsigned long>(std::numeric_limits<intType>::max()));
+    if(nnz==0) return 0.0;
+    double csr = double(nnz)*(sizeof(T)+sizeof(intType)) + double(nr+1)*sizeof(*A.pntrb(0));
+    return (csr-double(memory()))/double(nnz);
+  }
+
+  // number of stored values, including padding
+  unsigned long size() const
+  {
+    return vals.size();
+  }
+  // number of non-zero elements in the original matrix
+  unsigned long num_non_zero_elements() const
+  {
+    return nnz;
+  }
+  int rows() const
+  {
+    return nr;
+  }
+  int cols() const
+  {
+    return nc;
+  }
+
+  // memory footprint in bytes
+  unsigned long memory() const
+  {
+    return vals.size()*sizeof(T) + deltas.size()*sizeof(deltaType) + (rowBase.size()+rowIndex.size())*sizeof(intType);
+  }
+
+  const_pointer val(long n=0) const
+  {
+    return vals.data()+n;
+  }
+  pointer val(long n=0)
+  {
+    return vals.data()+n;
+  }
+
+  const_deltaPtr delta(long n=0) const
+  {
+    return deltas.data()+n;
+  }
+
+  const_intPtr base(long n=0) const
+  {
+    return rowBase.data()+n;
+  }
+
+  const_intPtr pntrb(long n=0) const
+  {
+    return rowIndex.data()+n;
+  }
+
+  const_intPtr pntre(long n=0) const
+  {
+    return rowIndex.data()+n+1;
+  }
+
+  private:
+
+  int nr,nc;
+  unsigned long nnz;
+  std::vector<T> vals;
+  std::vector<deltaType> deltas;
+  std::vector<intType> rowBase,rowIndex;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef QMCPLUSPLUS_AFQMC_MATRIXOPERATOR_H
+#define QMCPLUSPLUS_AFQMC_MATRIXOPERATOR_H
+
+#include<string>
+#include<assert.h>
+#include<boost/variant.hpp>
+#include<boost/multi_array.hpp>
+
+#include "Matrix/SparseMatrix.hpp"
+#include "Matrix/BlockSparseMatrix.hpp"
+#include "Matrix/SlicedEllMatrix.hpp"
+#include "Matrix/DeltaSparseMatrix.hpp"
+
+namespace qmcplusplus
+{
+
+// class that refers to a matrix stored in any of the available formats (csr, bsr, sell, dcsr or dense),
+// selected at runtime. The storage is not owned by the operator.
+// ma::product dispatches to the kernel of the referenced format.
+template<class T, class PtrType=int>
+class MatrixOperator
+{
+  public:
+
+  typedef T            Type_t;
+  typedef T            value_type;
+  typedef MatrixOperator<T,PtrType>  This_t;
+
+  typedef SparseMatrix<T,PtrType>    csr_type;
+  typedef BlockSparseMatrix<T>       bsr_type;
+  typedef SlicedEllMatrix<T>         sell_type;
+  typedef DeltaSparseMatrix<T>       dcsr_type;
+  typedef boost::multi_array<T,2>    dense_type;
+
+  // -6: matrix with storage format selected at runtime, see ma::product
+  const static int dimensionality = -6;
+  const static bool sparse = true;
+
+  MatrixOperator():nr(0),nc(0),A(static_cast<const csr_type*>(nullptr))
+  {
+  }
+
+  MatrixOperator(const csr_type& M):nr(M.rows()),nc(M.cols()),A(&M) {}
+  MatrixOperator(const bsr_type& M):nr(M.rows()),nc(M.cols()),A(&M) {}
+  MatrixOperator(const sell_type& M):nr(M.rows()),nc(M.cols()),A(&M) {}
+  MatrixOperator(const dcsr_type& M):nr(M.rows()),nc(M.cols()),A(&M) {}
+  MatrixOperator(const dense_type& M):nr(M.shape()[0]),nc(M.shape()[1]),A(&M) {}
+
+  int rows() const
+  {
+    return nr;
+  }
+  int cols() const
+  {
+    return nc;
+  }
+
+  bool is_dense() const
+  {
+    return A.which() == 4;
+  }
+
+  // name of the storage format
+  std::string format() const
+  {
+    static const char* names[] = {"csr","bsr","sell","dcsr","dense"};
+    return names[A.which()];
+  }
+
+  // number of stored elements, including the explicit zeros of bsr, sell and dcsr
+  unsigned long size() const
+  {
+    return boost::apply_visitor(size_visitor(),A);
+  }
+
+  /**
+   * Calls v(M), where M is a const pointer to the referenced matrix.
+   * The visitor must define result_type.
+   */
+  template<class Visitor>
+  typename Visitor::result_type apply(const Visitor& v) const
+  {
+    return boost::apply_visitor(v,A);
+  }
+
+  private:
+
+  struct size_visitor: public boost::static_visitor<unsigned long> 
+  {
+    template<class M>
+    unsigned long operator()(const M* m) const { return (m==nullptr)?0:m->size(); }
+    unsigned long operator()(const dense_type* m) const { return (m==nullptr)?0:m->num_elements(); }
+  };
+
+  int nr,nc;
+  boost::variant<const csr_type*, const bsr_type*, const sell_type*, const dcsr_type*, const dense_type*> A;
+
+};
+
+}
+
+#endif
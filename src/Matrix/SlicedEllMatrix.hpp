@@ -0,0 +1,235 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef QMCPLUSPLUS_AFQMC_SLICEDELLMATRIX_H
+#define QMCPLUSPLUS_AFQMC_SLICEDELLMATRIX_H
+
+#include<iostream>
+#include<vector>
+#include<limits>
+#include<assert.h>
+#include<algorithm>
+#include<numeric>
+
+namespace qmcplusplus
+{
+
+// class that implements a sparse matrix in sliced ELLPACK format (SELL-C-sigma).
+// Rows are sorted by length within windows of sigma rows and grouped in slices of C rows.
+// Each slice is padded to the length of its longest row and stored in column-major order,
+// e.g. element j of row r of slice s is at position pntrb(s) + j*C + r.
+// Padded elements have a value of zero and a valid column index.
+template<class T>
+class SlicedEllMatrix
+{
+  public:
+
+  typedef T            Type_t;
+  typedef T            value_type;
+  typedef T*           pointer;
+  typedef const T*     const_pointer;
+  typedef const int*   const_intPtr;
+  typedef int          intType;
+  typedef int*         intPtr;
+  typedef SlicedEllMatrix<T>  This_t;
+
+  // -4: sliced ELLPACK matrix, see ma::product
+  const static int dimensionality = -4;
+  const static bool sparse = true;
+
+  SlicedEllMatrix<T>():nr(0),nc(0),C(1),sigma(1),nnz(0),vals(),colms(),slicePtr(),sliceLen(),perm(),work()
+  {
+  }
+
+  ~SlicedEllMatrix<T>()
+  {
+  }
+
+  SlicedEllMatrix<T>(const SlicedEllMatrix<T> &rhs) = delete;
+  This_t& operator=(const SlicedEllMatrix<T> &rhs) = delete;
+
+  void clear() {
+    vals.clear();
+    colms.clear();
+    slicePtr.clear();
+    sliceLen.clear();
+    perm.clear();
+    std::vector<T>().swap(work);
+    nr=nc=nnz=0;
+    C=sigma=1;
+  }
+
+  /**
+   * Builds the SELL-C-sigma representation of a compressed CSR matrix, with slices of
+   * c rows and rows sorted by length within windows of s rows (s is rounded to a multiple of c).
+   * Returns the fraction of stored values that are non-zero in A.
+   */
+  template<class SpMat>
+  double initFrom(const SpMat& A, int c, int s)
+  {
+    assert(A.isCompressed());
+    assert(c > 0 && s > 0);
+    clear();
+    nr = A.rows();
+    nc = A.cols();
+    C = c;
+    sigma = std::max(1,s/C)*C;
+    nnz = A.size();
+    int nslices = (nr+C-1)/C;
+
+    auto rowlen = [&](int r) { return int(*A.pntre(r) - *A.pntrb(r)); };
+
+    // sort rows by decreasing length within each sigma window
+    perm.resize(nr);
+    std::iota(perm.begin(),perm.end(),0);
+    for(int r0=0; r0<nr; r0+=sigma)
+      std::stable_sort(perm.begin()+r0, perm.begin()+std::min(nr,r0+sigma),
+          [&](int a, int b) { return rowlen(a) > rowlen(b); });
+
+    slicePtr.resize(nslices+1);
+    sliceLen.resize(nslices);
+    slicePtr[0]=0;
+    for(int s_=0; s_<nslices; s_++) {
+      int len=0;
+      for(int r=s_*C, rend=std::min(nr,(s_+1)*C); r<rend; r++)
+        len = std::max(len,rowlen(perm[r]));
+      sliceLen[s_] = len;
+      slicePtr[s_+1] = slicePtr[s_] + len*C;
+    }
+
+    vals.resize(slicePtr[nslices],T(0));
+    colms.resize(slicePtr[nslices],0);
+    for(int s_=0; s_<nslices; s_++) {
+      for(int r=0; r<C && s_*C+r<nr; r++) {
+        int row = perm[s_*C+r];
+        int n = rowlen(row);
+        auto pv = A.val(*A.pntrb(row));
+        auto pc = A.indx(*A.pntrb(row));
+        int* c_ = colms.data()+slicePtr[s_]+r;
+        T* v_ = vals.data()+slicePtr[s_]+r;
+        for(int j=0; j<n; j++) {
+          v_[j*C] = pv[j];
+          c_[j*C] = pc[j];
+        }
+        // padding points to the last column of the row, to stay in cache
+        for(int j=n; j<sliceLen[s_]; j++)
+          c_[j*C] = (n>0)?pc[n-1]:0;
+      }
+    }
+
+    // indexed with int
+    assert(vals.size() < static_cast<unsigned long>(std::numeric_limits<intType>::max()));
+    return fill();
+  }
+
+  // fraction of stored values that are non-zero in the original matrix
+  double fill() const
+  {
+    return (vals.size()==0)?0.0:double(nnz)/double(vals.size());
+  }
+
+  // number of stored values, including padding
+  unsigned long size() const
+  {
+    return vals.size();
+  }
+  // number of non-zero elements in the original matrix
+  unsigned long num_non_zero_elements() const
+  {
+    return nnz;
+  }
+  int rows() const
+  {
+    return nr;
+  }
+  int cols() const
+  {
+    return nc;
+  }
+  int slice_height() const
+  {
+    return C;
+  }
+  int sort_window() const
+  {
+    return sigma;
+  }
+  int num_slices() const
+  {
+    return sliceLen.size();
+  }
+
+  // memory footprint in bytes
+  unsigned long memory() const
+  {
+    return vals.size()*sizeof(T) + (colms.size()+slicePtr.size()+sliceLen.size()+perm.size())*sizeof(intType);
+  }
+
+  const_pointer val(long n=0) const
+  {
+    return vals.data()+n;
+  }
+  pointer val(long n=0)
+  {
+    return vals.data()+n;
+  }
+
+  const_intPtr indx(long n=0) const
+  {
+    return colms.data()+n;
+  }
+  intPtr indx(long n=0)
+  {
+    return colms.data()+n;
+  }
+
+  // offset of each slice
+  const_intPtr pntrb(long n=0) const
+  {
+    return slicePtr.data()+n;
+  }
+  // number of stored columns of each slice
+  const_intPtr slice_length(long n=0) const
+  {
+    return sliceLen.data()+n;
+  }
+  // original row index of each (sorted) row
+  const_intPtr row_permutation(long n=0) const
+  {
+    return perm.data()+n;
+  }
+
+  // work space of the products with this matrix, grown to at least n elements
+  // products with the same matrix can not run concurrently
+  pointer work_buffer(std::size_t n) const
+  {
+    if(work.size() < n) work.resize(n);
+    return work.data();
+  }
+
+  private:
+
+  int nr,nc;
+  int C,sigma;
+  unsigned long nnz;
+  std::vector<T> vals;
+  std::vector<intType> colms,slicePtr,sliceLen,perm;
+  mutable std::vector<T> work;
+
+};
+
+}
+
+#endif
@@ -32,7 +32,9 @@ namespace qmcplusplus
 {
 
 // class that implements a sparse matrix in CSR format
-template<class T>
+// Column indices are always int, the type of the row pointers (rowIndex) is a template
+// parameter: use long for matrices with more than INT_MAX non-zero terms.
+template<class T, class PtrType=int>
 class SparseMatrix
 {
   public:
@@ -49,28 +51,34 @@ class SparseMatrix
   typedef typename std::vector<T>::const_iterator const_iterator;
   typedef typename std::vector<intType>::iterator int_iterator;
   typedef typename std::vector<intType>::const_iterator const_int_iterator;
-  typedef SparseMatrix<T>  This_t;
+  typedef PtrType         ptrType;
+  typedef const PtrType*  const_ptrPtr;
+  typedef PtrType*        ptrPtr;
+  typedef typename std::vector<ptrType>::iterator ptr_iterator;
+  typedef typename std::vector<ptrType>::const_iterator const_ptr_iterator;
+  typedef SparseMatrix<T,PtrType>  This_t;
 
   const static int dimensionality = -2;
   const static bool sparse = true;
   const static bool SHM = false;
 
-  SparseMatrix<T>():vals(),colms(),myrows(),rowIndex(),nr(0),nc(0),compressed(false),zero_based(true),row_offset(0),col_offset(0)
+  SparseMatrix():compressed(false),nr(0),nc(0),row_offset(0),col_offset(0),vals(),colms(),myrows(),rowIndex(),zero_based(true),compact(false),rows_released(false)
   {
   }
 
-  SparseMatrix<T>(int n,int m):vals(),colms(),myrows(),rowIndex(),nr(n),nc(m),compressed(false),zero_based(true),row_offset(0),col_offset(0)
+  SparseMatrix(int n,int m):compressed(false),nr(n),nc(m),row_offset(0),col_offset(0),vals(),colms(),myrows(),rowIndex(),zero_based(true),compact(false),rows_released(false)
   {
   }
 
-  ~SparseMatrix<T>()
+  ~SparseMatrix()
   {
   }
 
-  SparseMatrix<T>(const SparseMatrix<T> &rhs) = delete;
+  SparseMatrix(const This_t &rhs) = delete;
 
   void reserve(unsigned long n)
   {
+    restoreRows();
     vals.reserve(n);
     myrows.reserve(n);
     colms.reserve(n); 
@@ -81,6 +89,7 @@ class SparseMatrix
   {
     vals.resize(nnz);
     myrows.resize(nnz);
+    rows_released=false;
     colms.resize(nnz);
     rowIndex.resize(nr+1);
   }
@@ -92,6 +101,7 @@ class SparseMatrix
     rowIndex.clear();
     compressed=false;
     zero_based=true;
+    rows_released=false;
   }
 
   // does nothing, needed for compatibility with shared memory version
@@ -110,6 +120,7 @@ class SparseMatrix
 
   void setDims(int n, int m)
   {
+    restoreRows();
     nr=n;
     nc=m;
     compressed=false;
@@ -125,6 +136,31 @@ class SparseMatrix
   {
     return compressed;
   }
+
+  /**
+   * Compact (read-only) mode: once compressed, the COO row array and any excess capacity 
+   * are released, since the CSR kernels only need rowIndex, colms and vals. 
+   * Operations that need the row array (e.g. transpose, add) rebuild it from rowIndex 
+   * and it is released again on the next call to compress. 
+   * Returns the number of bytes released.
+   */
+  unsigned long setCompact(bool c=true)
+  {
+    compact=c;
+    if(compact && compressed) return releaseRows();
+    return 0;
+  }
+
+  bool isCompact() const
+  {
+    return compact;
+  }
+
+  // memory footprint in bytes, including reserved capacity
+  unsigned long memory() const
+  {
+    return vals.capacity()*sizeof(T) + (colms.capacity()+myrows.capacity())*sizeof(intType) + rowIndex.capacity()*sizeof(ptrType);
+  }
   unsigned long size() const
   {
     return vals.size();
@@ -159,36 +195,38 @@ class SparseMatrix
 
   const_intPtr row_data(long n=0) const 
   {
+    restoreRows();
     return myrows.data()+n;
   }
   intPtr row_data(long n=0) 
   {
+    restoreRows();
     return myrows.data()+n;
   }
 
-  const_intPtr row_index(long n=0) const 
+  const_ptrPtr row_index(long n=0) const 
   {
     return rowIndex.data()+n;
   }
-  intPtr row_index(long n=0) 
+  ptrPtr row_index(long n=0) 
   {
     return rowIndex.data()+n;
   }
 
-  const_intPtr index_begin(long n=0) const
+  const_ptrPtr index_begin(long n=0) const
   {
     return rowIndex.data()+n;
   }
-  intPtr index_begin(long n=0)
+  ptrPtr index_begin(long n=0)
   {
     return rowIndex.data()+n;
   }
 
-  const_intPtr index_end(long n=0) const
+  const_ptrPtr index_end(long n=0) const
   {
     return rowIndex.data()+n+1;
   }
-  intPtr index_end(long n=0)
+  ptrPtr index_end(long n=0)
   {
     return rowIndex.data()+n+1;
   }
@@ -214,31 +252,31 @@ class SparseMatrix
     return colms.data()+n;
   }
 
-  const_intPtr pntrb(long n=0) const
+  const_ptrPtr pntrb(long n=0) const
   {
     return rowIndex.data()+n;
   }
-  intPtr pntrb(long n=0)
+  ptrPtr pntrb(long n=0)
   {
     return rowIndex.data()+n;
   }
 
-  const_intPtr pntre(long n=0) const
+  const_ptrPtr pntre(long n=0) const
   {
     return rowIndex.data()+n+1;
   }
-  intPtr pntre(long n=0)
+  ptrPtr pntre(long n=0)
   {
     return rowIndex.data()+n+1;
   }
   // ******************************************
 
-  This_t& operator=(const SparseMatrix<T> &rhs) = delete; 
+  This_t& operator=(const This_t &rhs) = delete; 
 
   // should be using binary search, but this should not be used in performance critical 
   // areas in any case
-  intType find_element(int i, int j) {
-    for (int k = rowIndex[i]; k < rowIndex[i+1]; k++) {
+  ptrType find_element(int i, int j) {
+    for (ptrType k = rowIndex[i]; k < rowIndex[i+1]; k++) {
       if (colms[k] == j) return k;
     }
     return -1;
@@ -252,7 +290,7 @@ class SparseMatrix
 #ifdef ASSERT_SPARSEMATRIX
     assert(i>=0 && i<nr && j>=0 && j<nc && compressed); 
 #endif
-    intType idx = find_element(i,j);
+    ptrType idx = find_element(i,j);
     if (idx == -1) return zero;
     return vals[idx];
   }
@@ -262,7 +300,7 @@ class SparseMatrix
 #ifdef ASSERT_SPARSEMATRIX
     assert(i>=0 && i<nr && j>=0 && j<nc && compressed); 
 #endif
-    intType idx = find_element(i,j);
+    ptrType idx = find_element(i,j);
     if (idx == -1) return 0;
     return vals[idx];
   }
@@ -271,7 +309,9 @@ class SparseMatrix
   {
 #ifdef ASSERT_SPARSEMATRIX
     assert(i-row_offset>=0 && i-row_offset<nr && j-col_offset>=0 && j-col_offset<nc);
+    assert(vals.size()<static_cast<unsigned long>(std::numeric_limits<ptrType>::max()));
 #endif
+    restoreRows();
     compressed=false;
     myrows.push_back(i-row_offset);
     colms.push_back(j-col_offset);
@@ -280,6 +320,7 @@ class SparseMatrix
 
   void add(const std::vector<std::tuple<intType,intType,T>>& v, bool dummy=false)
   {
+    restoreRows();
     compressed=false;
     for(auto&& a: v) {
 #ifdef ASSERT_SPARSEMATRIX
@@ -289,11 +330,12 @@ class SparseMatrix
       colms.push_back(std::get<1>(a)-col_offset);
       vals.push_back(std::get<2>(a));
     }
-    assert(vals->size()<static_cast<unsigned long>(std::numeric_limits<intType>::max())); // right now limited to INT_MAX due to indexing problem.
+    assert(vals.size()<static_cast<unsigned long>(std::numeric_limits<ptrType>::max())); // limited by the type of the row pointers
   }
 
   void compress()
   {
+    restoreRows();
     // define comparison operator for tuple_iterator
     auto comp = [](std::tuple<intType, intType, value_type> const& a, std::tuple<intType, intType, value_type> const& b){return std::get<0>(a) < std::get<0>(b) || (!(std::get<0>(b) < std::get<0>(a)) && std::get<1>(a) < std::get<1>(b));};
 
@@ -305,7 +347,7 @@ class SparseMatrix
     // define rowIndex
     rowIndex.resize(nr+1);
     intType curr=-1;
-    for(intType n=0; n<myrows.size(); n++) {
+    for(ptrType n=0; n<myrows.size(); n++) {
       if( myrows[n] != curr ) {
         intType old = curr;
         curr = myrows[n];
@@ -313,19 +355,25 @@ class SparseMatrix
       }
     }
     for(int i=myrows.back()+1; i<rowIndex.size(); i++)
-      rowIndex[i] = static_cast<intType>(vals.size());
+      rowIndex[i] = static_cast<ptrType>(vals.size());
     compressed=true;
+    if(compact) releaseRows();
 
   }
 
   bool remove_repeated_and_compress()
   {
+    restoreRows();
 #ifdef ASSERT_SPARSEMATRIX
     assert(myrows.size() == colms.size() && myrows.size() == vals.size());
 #endif
 
     if(myrows.size() <= 1) return true;
+    // keep the row array until the repeated terms are removed
+    bool compact_ = compact;
+    compact = false;
     compress();
+    compact = compact_;
 
       int_iterator first_r=myrows.begin(), last_r=myrows.end();
       int_iterator first_c=colms.begin(), last_c=colms.end();
@@ -376,7 +424,7 @@ class SparseMatrix
 
       // define rowIndex
       intType curr=-1;
-      for(intType n=0; n<myrows.size(); n++) {
+      for(ptrType n=0; n<myrows.size(); n++) {
         if( myrows[n] != curr ) {
           intType old = curr;
           curr = myrows[n];
@@ -384,12 +432,14 @@ class SparseMatrix
         }
       }
       for(int i=myrows.back()+1; i<rowIndex.size(); i++)
-        rowIndex[i] = static_cast<intType>(vals.size());
+        rowIndex[i] = static_cast<ptrType>(vals.size());
+      if(compact) releaseRows();
 
     return true;
   }
 
   void transpose() {
+    restoreRows();
     assert(myrows.size() == colms.size() && myrows.size() == vals.size());
     for(std::vector<intType>::iterator itR=myrows.begin(),itC=colms.begin(); itR!=myrows.end(); ++itR,++itC)
       std::swap(*itR,*itC);
@@ -397,28 +447,28 @@ class SparseMatrix
     compress();
   }
 
-  SparseMatrix<T>& operator*=(const double rhs ) 
+  This_t& operator*=(const double rhs ) 
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= rhs;
     return *this; 
   }
 
-  SparseMatrix<T>& operator*=(const std::complex<double> rhs ) 
+  This_t& operator*=(const std::complex<double> rhs ) 
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= rhs;
     return *this; 
   }
 
-  SparseMatrix<T>& operator*=(const float rhs )  
+  This_t& operator*=(const float rhs )  
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= T(rhs);
     return *this;
   }
 
-  SparseMatrix<T>& operator*=(const std::complex<float> rhs )  
+  This_t& operator*=(const std::complex<float> rhs )  
   {
     for(iterator it=vals.begin(); it!=vals.end(); it++)
       (*it) *= T(rhs);
@@ -426,23 +476,26 @@ class SparseMatrix
   }
 
   void toZeroBase() {
+    restoreRows();
     if(zero_based) return;
     zero_based=true;
     for (intType& i : colms ) i--; 
     for (intType& i : myrows ) i--; 
-    for (intType& i : rowIndex ) i--; 
+    for (ptrType& i : rowIndex ) i--; 
   }
 
   void toOneBase() {
+    restoreRows();
     if(!zero_based) return;
     zero_based=false;
     for (intType& i : colms ) i++; 
     for (intType& i : myrows ) i++; 
-    for (intType& i : rowIndex ) i++; 
+    for (ptrType& i : rowIndex ) i++; 
   }
 
-  friend std::ostream& operator<<(std::ostream& out, const SparseMatrix<T>& rhs)
+  friend std::ostream& operator<<(std::ostream& out, const This_t& rhs)
   {
+    rhs.restoreRows();
     for(unsigned long i=0; i<rhs.vals.size(); i++)
       out<<"(" <<rhs.myrows[i] <<"," <<rhs.colms[i] <<":" <<rhs.vals[i] <<")\n"; 
     return out;
@@ -451,44 +504,73 @@ class SparseMatrix
   // this is ugly, but I need to code quickly 
   // so I'm doing this to avoid adding hdf5 support here 
   std::vector<T>* getVals() { return &vals; } 
-  std::vector<intType>* getRows() { return &myrows; }
+  std::vector<intType>* getRows() { restoreRows(); return &myrows; }
   std::vector<intType>* getCols() { return &colms; }
-  std::vector<intType>* getRowIndex() { return &rowIndex; }
+  std::vector<ptrType>* getRowIndex() { return &rowIndex; }
 
   iterator vals_begin() { return vals.begin(); }
-  int_iterator rows_begin() { return myrows.begin(); }
+  int_iterator rows_begin() { restoreRows(); return myrows.begin(); }
   int_iterator cols_begin() { return colms.begin(); }
-  int_iterator rowIndex_begin() { return rowIndex.begin(); }
+  ptr_iterator rowIndex_begin() { return rowIndex.begin(); }
   const_iterator vals_begin() const { return vals.begin(); }
   const_int_iterator cols_begin() const { return colms.begin(); }
-  const_int_iterator rowIndex_begin() const { return rowIndex.begin(); }
+  const_ptr_iterator rowIndex_begin() const { return rowIndex.begin(); }
   const_iterator vals_end() const { return vals.end(); }
-  const_int_iterator rows_end() const { return myrows.end(); }
+  const_int_iterator rows_end() const { restoreRows(); return myrows.end(); }
   const_int_iterator cols_end() const { return colms.end(); }
-  const_int_iterator rowIndex_end() const { return rowIndex.end(); }
+  const_ptr_iterator rowIndex_end() const { return rowIndex.end(); }
   iterator vals_end() { return vals.end(); }
-  int_iterator rows_end() { return myrows.end(); }
+  int_iterator rows_end() { restoreRows(); return myrows.end(); }
   int_iterator cols_end() { return colms.end(); }
-  int_iterator rowIndex_end() { return rowIndex.end(); }
+  ptr_iterator rowIndex_end() { return rowIndex.end(); }
 
   void setRowsFromRowIndex()
+  {
+    rows_released=false;
+    fillRows();
+  }
+  bool zero_base() const { return zero_based; }
+
+  private:
+
+  void fillRows() const
   {
     intType shift = zero_based?0:1;
     myrows.resize(vals.size());
     for(int i=0; i<nr; i++)
-     for(intType j=rowIndex[i]; j<rowIndex[i+1]; j++)
+     for(ptrType j=rowIndex[i]-shift; j<rowIndex[i+1]-shift; j++)
       myrows[j]=i+shift;
   }
-  bool zero_base() const { return zero_based; }
 
-  private:
+  // rebuilds the row array if it was released in compact mode
+  void restoreRows() const
+  {
+    if(!rows_released) return;
+    rows_released=false;
+    fillRows();
+  }
+
+  unsigned long releaseRows()
+  {
+    unsigned long m0 = memory();
+    std::vector<intType>().swap(myrows);
+    vals.shrink_to_fit();
+    colms.shrink_to_fit();
+    rowIndex.shrink_to_fit();
+    rows_released=true;
+    return m0-memory();
+  }
 
   bool compressed;
   int nr,nc;
   intType row_offset, col_offset;
   std::vector<T> vals;
-  std::vector<intType> colms,myrows,rowIndex;
+  std::vector<intType> colms;
+  mutable std::vector<intType> myrows;
+  std::vector<ptrType> rowIndex;
   bool zero_based;
+  bool compact;
+  mutable bool rows_released;
   Type_t zero; // zero for return value
 
 };
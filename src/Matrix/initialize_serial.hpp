@@ -20,6 +20,7 @@
 
 #include<string>
 #include<vector>
+#include<limits>
 
 #include "Configuration.h"
 #include "io/hdf_archive.h"
@@ -32,6 +33,19 @@ namespace qmcplusplus
 namespace afqmc
 {
 
+// checks that a sparse matrix with n terms can be indexed with the row pointers of SpMat
+template<class SpMat>
+inline bool check_sparse_size(unsigned long n, const std::string& name)
+{
+  using ptrType = typename SpMat::ptrType;
+  if(n >= static_cast<unsigned long>(std::numeric_limits<ptrType>::max())) {
+    std::cerr<<" Error: Too many terms in " <<name <<" (" <<n <<") for " <<8*sizeof(ptrType) 
+             <<"-bit row pointers. Rebuild with -DQMC_AFQMC_LONG_SPARSE=1. " <<std::endl;
+    return false;
+  }
+  return true;
+}
+
 template< class SpMat,
           class Mat>
 inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys, Mat& Propg1, SpMat& Spvn, Mat& haj, SpMat& Vakbl)
@@ -131,11 +145,18 @@ inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys,
 
   // read half-rotated hamiltonian
   // careful here!!!
+  // the number of terms is taken from the datasets, Idata[1] overflows beyond INT_MAX terms 
   Vakbl.setDims(Idata[2],Idata[3]);
-  Vakbl.resize(Idata[1]);
   if(!dump.read(*(Vakbl.getVals()),"SpHijkl_vals")) return false;
   if(!dump.read(*(Vakbl.getCols()),"SpHijkl_cols")) return false;
   if(!dump.read(*(Vakbl.getRowIndex()),"SpHijkl_rowIndex")) return false;
+  if(!check_sparse_size<SpMat>(Vakbl.getVals()->size(),"Vakbl")) return false;
+  if(Vakbl.getCols()->size() != Vakbl.getVals()->size() || 
+     Vakbl.getRowIndex()->size() != Idata[2]+1 || 
+     Vakbl.getRowIndex()->back() != Vakbl.getVals()->size()) {
+    std::cerr<<" Inconsistent dimensions in SpHijkl. " <<std::endl;
+    return false;
+  }
   Vakbl.setRowsFromRowIndex();
   // morph to "compacted" notation for miniapp
   { 
@@ -181,6 +202,7 @@ inline bool Initialize(hdf_archive& dump, const double dt, base::afqmc_sys& sys,
 
   assert(nrows == NMO*NMO);
   assert(static_cast<int>(Ldims[3]) == NMO);
+  if(!check_sparse_size<SpMat>(ntot,"Spvn")) return false;
 
   // read 1-body propagator
   if(!dump.read(vvec,"Spvn_propg1")) return false;
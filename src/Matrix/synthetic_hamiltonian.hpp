@@ -0,0 +1,365 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file synthetic_hamiltonian.hpp
+ *  @brief Generator of synthetic Hamiltonians for benchmarks of any size
+ *
+ *  Two models are available:
+ *   - random: Cholesky vectors with random symmetric elements. Off-diagonal elements are
+ *     non-zero with probability sparsity. With block > 0, the orbitals are split in blocks
+ *     of block orbitals and every Cholesky vector only couples orbitals within one block.
+ *     The 1-body Hamiltonian has increasing diagonal elements and small random couplings.
+ *   - hubbard: 1D Hubbard ring with hopping t=1 and on-site interaction U=4, with one
+ *     Cholesky vector per site (nchol = NMO).
+ *  The trial wave function occupies the first NAEA orbitals of both spins.
+ *
+ *  The data is kept in the layout of the hdf5 file read by afqmc::Initialize. It can be written
+ *  to a file with write_hamiltonian, or used directly with the in-memory version of Initialize.
+ */
+
+#ifndef QMCPLUSPLUS_AFQMC_SYNTHETIC_HAMILTONIAN_HPP
+#define QMCPLUSPLUS_AFQMC_SYNTHETIC_HAMILTONIAN_HPP
+
+#include<string>
+#include<vector>
+#include<random>
+#include<algorithm>
+#include<sstream>
+#include<cmath>
+#include<tuple>
+#include<utility>
+
+#include "Configuration.h"
+#include "io/hdf_archive.h"
+#include "Numerics/ma_operations.hpp"
+#include "AFQMC/afqmc_sys.hpp"
+#include "Matrix/initialize_serial.hpp"
+
+namespace qmcplusplus
+{
+
+namespace afqmc
+{
+
+struct SyntheticParameters
+{
+  std::string model;  // random or hubbard
+  int NMO;
+  int NAEA;
+  int nchol;          // ignored by hubbard
+  double sparsity;    // probability of a non-zero off-diagonal element in a Cholesky vector
+  int block;          // size of the orbital blocks of the Cholesky vectors, 0 for no blocks
+  unsigned seed;
+
+  SyntheticParameters():model("random"),NMO(0),NAEA(0),nchol(0),sparsity(0.2),block(0),seed(7) {}
+
+  /**
+   * Parses NMO,NAEA,nchol[,sparsity[,block[,model]]]. Returns false on errors.
+   */
+  bool parse(const std::string& spec)
+  {
+    std::string s(spec);
+    std::replace(s.begin(),s.end(),',',' ');
+    std::istringstream in(s);
+    if(!(in>>NMO>>NAEA>>nchol)) return false;
+    if(in>>sparsity)
+      if(in>>block)
+        in>>model;
+    return valid();
+  }
+
+  bool valid() const
+  {
+    return NMO > 0 && NAEA > 0 && NAEA <= NMO && (nchol > 0 || model == "hubbard") &&
+           sparsity >= 0.0 && sparsity <= 1.0 && block >= 0 && (model == "random" || model == "hubbard");
+  }
+};
+
+/**
+ * Hamiltonian in the layout of the hdf5 file read by afqmc::Initialize:
+ * 1-body Hamiltonian and trial wave function of both spins, half-rotated 2-body Hamiltonian
+ * in csr format over the [2*NMO*NMO] spin-orbital pairs, 1-body propagator and
+ * Cholesky vectors as (ik,n) pairs (not scaled by sqrt(dt)).
+ */
+struct SyntheticHamiltonian
+{
+  int NMO;
+  int NAEA;
+  int nchol;
+  std::vector<IndexType> hij_indx;
+  std::vector<ValueType> hij;
+  std::vector<ValueType> wfn;      // [2*NMO][NAEA]
+  std::vector<ValueType> Vakbl_vals;
+  std::vector<int> Vakbl_cols;
+  std::vector<int> Vakbl_rowIndex;
+  std::vector<ValueType> propg1;   // [NMO][NMO]
+  std::vector<int> Spvn_index;     // (ik,n) pairs
+  std::vector<ValueType> Spvn_vals;
+};
+
+/**
+ * Builds a synthetic Hamiltonian. The 1-body propagator, exp(-dt/2 h1), is built for the time step dt.
+ * Elements of the 2-body Hamiltonian smaller than cutoff are dropped.
+ */
+inline void generate_hamiltonian(const SyntheticParameters& p, double dt, SyntheticHamiltonian& H,
+                                 double cutoff=1e-8)
+{
+  const int NMO = p.NMO;
+  const int NAEA = p.NAEA;
+  const int nchol = (p.model == "hubbard")?NMO:p.nchol;
+  H.NMO = NMO;
+  H.NAEA = NAEA;
+  H.nchol = nchol;
+
+  std::mt19937 gen(p.seed);
+  std::uniform_real_distribution<double> u(-1.0,1.0), u01(0.0,1.0);
+
+  // Cholesky vectors as (ik,n,value) triplets, so that the memory scales with the number of non-zeros,
+  // and 1-body Hamiltonian
+  std::vector<std::tuple<int,int,double>> L;
+  std::vector<double> h1(NMO*NMO,0.0);
+  if(p.model == "hubbard") {
+    const double t = 1.0, U = 4.0;
+    for(int i=0; i<NMO; i++) {
+      L.emplace_back(i*NMO+i,i,std::sqrt(U));
+      if(NMO > 1) {
+        h1[i*NMO+(i+1)%NMO] = -t;
+        h1[((i+1)%NMO)*NMO+i] = -t;
+      }
+    }
+  } else {
+    const int bsize = (p.block > 0)?std::min(p.block,NMO):NMO;
+    const int nblk = (NMO+bsize-1)/bsize;
+    for(int n=0; n<nchol; n++) {
+      int i0 = (n%nblk)*bsize, i1 = std::min(NMO,i0+bsize);
+      for(int i=i0; i<i1; i++)
+        for(int k=i; k<i1; k++)
+          if(u01(gen) < p.sparsity || i == k) {
+            double v = 0.3*u(gen)/std::sqrt(double(nchol));
+            L.emplace_back(i*NMO+k,n,v);
+            if(i != k) L.emplace_back(k*NMO+i,n,v);
+          }
+    }
+    for(int i=0; i<NMO; i++)
+      for(int k=i; k<NMO; k++) {
+        double v = (i == k)?(-2.0+0.1*i):0.05*u(gen);
+        h1[i*NMO+k] = v;
+        h1[k*NMO+i] = v;
+      }
+  }
+
+  // 1-body Hamiltonian of the occupied orbitals of both spins
+  H.hij_indx.clear();
+  H.hij.clear();
+  for(int s=0; s<2; s++)
+    for(int a=0; a<NAEA; a++)
+      for(int j=0; j<NMO; j++) {
+        H.hij_indx.push_back((a+s*NMO)*NMO+j);
+        H.hij.push_back(ValueType(h1[a*NMO+j]));
+      }
+
+  // trial wave function
+  H.wfn.assign(2*NMO*NAEA,ValueType(0.0));
+  for(int s=0; s<2; s++)
+    for(int a=0; a<NAEA; a++)
+      H.wfn[(s*NMO+a)*NAEA+a] = ValueType(1.0);
+
+  // half-rotated 2-body Hamiltonian, from V[ak][bl] = sum_n L[n][a*NMO+k] * L[n][b*NMO+l],
+  // built one occupied orbital a at a time:
+  // Vakbl[(s1,a,k)][(s2,b,l)] = V[ak][bl] - delta(s1,s2) V[al][bk]
+  // The half-rotated Cholesky vectors, the elements of L with an occupied orbital a, are kept sparse,
+  // sorted by ak within each vector.
+  std::vector<std::vector<std::pair<int,double>>> Lhr(nchol);
+  for(const auto& t: L)
+    if(std::get<0>(t) < NAEA*NMO)
+      Lhr[std::get<1>(t)].emplace_back(std::get<0>(t),std::get<2>(t));
+  for(auto& Ln: Lhr)
+    std::sort(Ln.begin(),Ln.end());
+  ComplexMatrix Va(extents[NMO][NAEA*NMO]);
+  // rows of spin s1=1 are collected separately and appended after the rows of spin 0
+  std::vector<ValueType> vals[2];
+  std::vector<int> cols[2];
+  std::vector<int> rowIndex[2];
+  for(int s1=0; s1<2; s1++) rowIndex[s1].assign(NMO*NMO+1,0);
+  for(int a=0; a<NAEA; a++) {
+    std::fill(Va.data(),Va.data()+Va.num_elements(),ValueType(0.0));
+    for(const auto& Ln: Lhr) {
+      auto first = std::lower_bound(Ln.begin(),Ln.end(),std::make_pair(a*NMO,-1.0));
+      for(auto it = first; it != Ln.end() && it->first < (a+1)*NMO; ++it)
+        for(const auto& bl: Ln)
+          Va[it->first-a*NMO][bl.first] += it->second*bl.second;
+    }
+    for(int s1=0; s1<2; s1++)
+      for(int k=0; k<NMO; k++) {
+        for(int s2=0; s2<2; s2++)
+          for(int b=0; b<NAEA; b++)
+            for(int l=0; l<NMO; l++) {
+              ValueType v = Va[k][b*NMO+l];
+              if(s1 == s2) v -= Va[l][b*NMO+k];
+              if(std::abs(v) > cutoff) {
+                vals[s1].push_back(v);
+                cols[s1].push_back((s2*NMO+b)*NMO+l);
+              }
+            }
+        rowIndex[s1][a*NMO+k+1] = vals[s1].size();
+      }
+  }
+  // rows of unoccupied orbitals are empty
+  for(int s1=0; s1<2; s1++)
+    for(int r=NAEA*NMO+1; r<=NMO*NMO; r++)
+      rowIndex[s1][r] = vals[s1].size();
+  H.Vakbl_vals = vals[0];
+  H.Vakbl_vals.insert(H.Vakbl_vals.end(),vals[1].begin(),vals[1].end());
+  H.Vakbl_cols = cols[0];
+  H.Vakbl_cols.insert(H.Vakbl_cols.end(),cols[1].begin(),cols[1].end());
+  H.Vakbl_rowIndex = rowIndex[0];
+  for(int r=1; r<=NMO*NMO; r++)
+    H.Vakbl_rowIndex.push_back(vals[0].size()+rowIndex[1][r]);
+
+  // 1-body propagator exp(-dt/2 h1) from its Taylor series
+  {
+    ComplexMatrix P(extents[NMO][NMO]), T1(extents[NMO][NMO]), T2(extents[NMO][NMO]), h(extents[NMO][NMO]);
+    for(int i=0; i<NMO; i++)
+      for(int j=0; j<NMO; j++) {
+        h[i][j] = h1[i*NMO+j];
+        P[i][j] = T1[i][j] = ValueType((i==j)?1.0:0.0);
+      }
+    for(int o=1; o<8; o++) {
+      ma::product(ValueType(-0.5*dt/o),h,T1,ValueType(0.0),T2);
+      std::swap(T1,T2);
+      for(int i=0; i<NMO; i++)
+        for(int j=0; j<NMO; j++)
+          P[i][j] += T1[i][j];
+    }
+    H.propg1.assign(P.data(),P.data()+P.num_elements());
+  }
+
+  // Cholesky vectors as (ik,n) pairs, sorted by ik and n
+  std::sort(L.begin(),L.end());
+  H.Spvn_index.clear();
+  H.Spvn_vals.clear();
+  H.Spvn_index.reserve(2*L.size());
+  H.Spvn_vals.reserve(L.size());
+  for(const auto& t: L)
+    if(std::get<2>(t) != 0.0) {
+      H.Spvn_index.push_back(std::get<0>(t));
+      H.Spvn_index.push_back(std::get<1>(t));
+      H.Spvn_vals.push_back(ValueType(std::get<2>(t)));
+    }
+}
+
+/**
+ * Writes the Hamiltonian with the layout read by afqmc::Initialize.
+ */
+inline bool write_hamiltonian(hdf_archive& dump, SyntheticHamiltonian& H)
+{
+  const int NMO = H.NMO;
+  const int NAEA = H.NAEA;
+  if(!dump.push("Wavefunctions")) return false;
+  if(!dump.push("PureSingleDeterminant")) return false;
+  std::vector<int> dims = {0, static_cast<int>(H.Vakbl_vals.size()), 2*NMO*NMO, 2*NMO*NMO, NMO, NAEA, NAEA, 0};
+  if(!dump.write(dims,"dims")) return false;
+  if(!dump.write(H.hij_indx,"hij_indx")) return false;
+  if(!dump.write(H.hij,"hij")) return false;
+  if(!dump.write(H.wfn,"Wavefun")) return false;
+  if(!dump.write(H.Vakbl_vals,"SpHijkl_vals")) return false;
+  if(!dump.write(H.Vakbl_cols,"SpHijkl_cols")) return false;
+  if(!dump.write(H.Vakbl_rowIndex,"SpHijkl_rowIndex")) return false;
+  dump.pop();
+  dump.pop();
+
+  if(!dump.push("Propagators")) return false;
+  if(!dump.push("phaseless_ImpSamp_ForceBias")) return false;
+  std::vector<long> Ldims = {static_cast<long>(H.Spvn_vals.size()), long(NMO)*NMO, H.nchol, NMO, 1};
+  std::vector<int> block_sizes = {static_cast<int>(H.Spvn_vals.size())};
+  if(!dump.write(Ldims,"Spvn_dims")) return false;
+  if(!dump.write(H.propg1,"Spvn_propg1")) return false;
+  if(!dump.write(block_sizes,"Spvn_block_sizes")) return false;
+  if(!dump.write(H.Spvn_index,"Spvn_index_0")) return false;
+  if(!dump.write(H.Spvn_vals,"Spvn_vals_0")) return false;
+  dump.pop();
+  dump.pop();
+  return true;
+}
+
+/**
+ * Initializes the data structures of the miniapp from a synthetic Hamiltonian,
+ * with the same result as writing it to a file and reading it with Initialize(hdf_archive&,...).
+ */
+template< class SpMat,
+          class Mat>
+inline bool Initialize(const SyntheticHamiltonian& H, const double dt, base::afqmc_sys& sys, Mat& Propg1, SpMat& Spvn,
+                       Mat& haj, SpMat& Vakbl)
+{
+  const int NMO = H.NMO;
+  const int NAEA = H.NAEA;
+
+  std::cout<<"  Synthetic Hamiltonian. \n";
+
+  sys.setup(NMO,NAEA);
+
+  haj.resize(extents[2*NAEA][NMO]);
+  for(int n=0; n<H.hij_indx.size(); n++) {
+    int i = H.hij_indx[n]/NMO;
+    int j = H.hij_indx[n]%NMO;
+    int a = (i<NMO)?i:(i-NMO+NAEA);
+    haj[a][j] = H.hij[n];
+  }
+
+  sys.trialwfn_alpha.resize(extents[NMO][NAEA]);
+  sys.trialwfn_beta.resize(extents[NMO][NAEA]);
+  for(int i=0, ij=0; i<NMO; i++)
+    for(int j=0; j<NAEA; j++, ij++) {
+      using std::conj;
+      sys.trialwfn_alpha[i][j] = conj(H.wfn[ij]);
+      sys.trialwfn_beta[i][j] = conj(H.wfn[NMO*NAEA+ij]);
+    }
+
+  // 2-body Hamiltonian in "compacted" notation
+  if(!check_sparse_size<SpMat>(H.Vakbl_vals.size(),"Vakbl")) return false;
+  Vakbl.setDims(2*NMO*NAEA,2*NMO*NAEA);
+  Vakbl.reserve(H.Vakbl_vals.size());
+  auto compact = [&](int ik) {
+    int i = ik/NMO;
+    int k = ik%NMO;
+    int a = (i<NMO)?i:(i-NMO+NAEA);
+    return a*NMO+k;
+  };
+  for(int r=0; r<2*NMO*NMO; r++)
+    for(int n=H.Vakbl_rowIndex[r]; n<H.Vakbl_rowIndex[r+1]; n++)
+      Vakbl.add(compact(r),compact(H.Vakbl_cols[n]),H.Vakbl_vals[n]);
+  Vakbl.compress();
+
+  Propg1.resize(extents[NMO][NMO]);
+  for(int i=0, ij=0; i<NMO; i++)
+    for(int j=0; j<NMO; j++, ij++)
+      Propg1[i][j] = H.propg1[ij];
+
+  if(!check_sparse_size<SpMat>(H.Spvn_vals.size(),"Spvn")) return false;
+  Spvn.setDims(NMO*NMO,H.nchol);
+  Spvn.reserve(H.Spvn_vals.size());
+  for(int n=0; n<H.Spvn_vals.size(); n++)
+    Spvn.add(H.Spvn_index[2*n],H.Spvn_index[2*n+1],H.Spvn_vals[n]);
+  Spvn.compress();
+  Spvn *= std::sqrt(dt);
+
+  return true;
+}
+
+}  // afqmc
+
+} // qmcplusplus
+
+#endif
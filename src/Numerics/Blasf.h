@@ -48,6 +48,10 @@
 #define sgemm sgemm_
 #define zgemm zgemm_
 #define cgemm cgemm_
+#define dtrsm dtrsm_
+#define strsm strsm_
+#define ztrsm ztrsm_
+#define ctrsm ctrsm_
 #define dgemv dgemv_
 #define sgemv sgemv_
 #define zgemv zgemv_
@@ -185,6 +189,22 @@ void cgemm(const char &, const char &, const int &, const int &, const int &,
            const int &, const std::complex<float> *, const int &,
            const std::complex<float> &, std::complex<float> *, const int &);
 
+void dtrsm(const char &, const char &, const char &, const char &, const int &,
+           const int &, const double &, const double *, const int &, double *,
+           const int &);
+
+void strsm(const char &, const char &, const char &, const char &, const int &,
+           const int &, const float &, const float *, const int &, float *,
+           const int &);
+
+void ztrsm(const char &, const char &, const char &, const char &, const int &,
+           const int &, const std::complex<double> &, const std::complex<double> *,
+           const int &, std::complex<double> *, const int &);
+
+void ctrsm(const char &, const char &, const char &, const char &, const int &,
+           const int &, const std::complex<float> &, const std::complex<float> *,
+           const int &, std::complex<float> *, const int &);
+
 void dgemv(const char &trans, const int &nr, const int &nc, const double &alpha,
            const double *amat, const int &lda, const double *bv,
            const int &incx, const double &beta, double *cv, const int &incy);
@@ -286,6 +286,45 @@ struct BLAS
   {
     cgemm(Atrans, Btrans, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
   }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int M, int N,
+                          double alpha, const double *A, int lda, double *B, int ldb)
+  {
+    dtrsm(side, uplo, transa, diag, M, N, alpha, A, lda, B, ldb);
+  }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int M, int N,
+                          float alpha, const float *A, int lda, float *B, int ldb)
+  {
+    strsm(side, uplo, transa, diag, M, N, alpha, A, lda, B, ldb);
+  }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int M, int N,
+                          std::complex<double> alpha, const std::complex<double> *A, int lda,
+                          std::complex<double> *B, int ldb)
+  {
+    ztrsm(side, uplo, transa, diag, M, N, alpha, A, lda, B, ldb);
+  }
+
+  inline static void trsm(char side, char uplo, char transa, char diag, int M, int N,
+                          std::complex<float> alpha, const std::complex<float> *A, int lda,
+                          std::complex<float> *B, int ldb)
+  {
+    ctrsm(side, uplo, transa, diag, M, N, alpha, A, lda, B, ldb);
+  }
+
+  /** batch of gemm with matrices of equal dimensions: C[i] = alpha*op(A[i])*op(B[i]) + beta*C[i]
+   *  The batch is issued as a sequence of gemm calls, since the BLAS library does not provide a batched interface.
+   */
+  template <typename T>
+  inline static void gemm_batched(char Atrans, char Btrans, int M, int N, int K,
+                                  T alpha, const T *const *A, int lda,
+                                  const T *const *B, int ldb, T beta,
+                                  T *const *C, int ldc, int batch)
+  {
+    for (int i = 0; i < batch; ++i)
+      gemm(Atrans, Btrans, M, N, K, alpha, A[i], lda, B[i], ldb, beta, C[i], ldc);
+  }
   
 
   template <typename T>
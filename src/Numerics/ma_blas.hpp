@@ -26,6 +26,7 @@
 #include<utility> //std::enable_if
 #include<cassert>
 #include<iostream>
+#include<vector>
 
 namespace ma{
 
@@ -125,6 +126,47 @@ MultiArray2DC gemm(MultiArray2DA const& a, MultiArray2DB const& b, MultiArray2DC
 	return gemm(1., a, b, 0., std::forward<MultiArray2DC>(c));
 }
 
+// strided batch of gemm, the leading dimension of the 3D arrays is the batch index:
+//	gemm_batched<'N', 'N'>(1., A, B, 0., C); // T(C[i]) = T(A[i])*T(B[i]) for every i
+// A (or B) with a single matrix (shape()[0] == 1) is used in every product of the batch.
+template<char TA, char TB, class T, class MultiArray3DA, class MultiArray3DB, class MultiArray3DC, 
+	typename = typename std::enable_if< MultiArray3DA::dimensionality == 3 and MultiArray3DB::dimensionality == 3 and std::decay<MultiArray3DC>::type::dimensionality == 3>::type
+>
+MultiArray3DC gemm_batched(T alpha, MultiArray3DA const& a, MultiArray3DB const& b, T beta, MultiArray3DC&& c){
+	using element = typename std::decay<MultiArray3DC>::type::element;
+	assert( a.strides()[2] == 1 );
+	assert( b.strides()[2] == 1 );
+	assert( c.strides()[2] == 1 );
+	assert( a.shape()[0] == c.shape()[0] or a.shape()[0] == 1 );
+	assert( b.shape()[0] == c.shape()[0] or b.shape()[0] == 1 );
+	assert( (TA == 'N') || (TA == 'T') || (TA == 'H')  );
+	assert( (TB == 'N') || (TB == 'T') || (TB == 'H')  );
+	int batch = c.shape()[0];
+	if(batch == 0) return std::forward<MultiArray3DC>(c);
+	int M = (TA == 'N')?a.shape()[2]:a.shape()[1];
+	int K = (TA == 'N')?a.shape()[1]:a.shape()[2];
+	int N = (TB == 'N')?b.shape()[1]:b.shape()[2];
+	assert( K == ((TB == 'N')?b.shape()[2]:b.shape()[1]) );
+	assert( c.shape()[1] == N and c.shape()[2] == M );
+	std::vector<const element*> pa(batch), pb(batch);
+	std::vector<element*> pc(batch);
+	for(int i=0; i<batch; i++) {
+		pa[i] = a.origin() + ((a.shape()[0] == 1)?0:i*a.strides()[0]);
+		pb[i] = b.origin() + ((b.shape()[0] == 1)?0:i*b.strides()[0]);
+		pc[i] = c.origin() + i*c.strides()[0];
+	}
+	BLAS::gemm_batched(
+		TA, TB, 
+		M, N, K, element(alpha), 
+		pa.data(), a.strides()[1], 
+		pb.data(), b.strides()[1],
+		element(beta), 
+		pc.data(), c.strides()[1],
+		batch
+	);
+	return std::forward<MultiArray3DC>(c);
+}
+
 }
 
 #ifdef _TEST_MA_BLAS
@@ -143,9 +143,124 @@ MultiArray2DC product(T alpha, SparseMatrixA const& A, MultiArray2DB const& B, T
         return std::forward<MultiArray2DC>(C);
 }
 
+// block sparse matrix-MultiArray interface 
+template<class T, class SparseMatrixA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                SparseMatrixA::dimensionality == -3 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void // TODO change to use dispatch 
+>
+MultiArray2DC product(T alpha, SparseMatrixA const& A, MultiArray2DB const& B, T beta, MultiArray2DC&& C){
+        assert(op_tag<MultiArray2DB>::value == 'N');
+        assert( arg(B).strides()[1] == 1 );
+        assert( std::forward<MultiArray2DC>(C).strides()[1] == 1 );
+        if(op_tag<SparseMatrixA>::value == 'N') {
+            assert(arg(A).rows() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(A).cols() == arg(B).shape()[0]);
+            assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+        } else {
+            assert(arg(A).rows() == arg(B).shape()[0]);
+            assert(arg(A).cols() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+        }        
+
+        using Type = typename std::decay<decltype(*arg(A).val())>::type;
+        mySPBLAS::bsrmm( op_tag<SparseMatrixA>::value, 
+            arg(A).rows(), arg(B).shape()[1], arg(A).cols(), arg(A).block_size(), 
+            Type(alpha), 
+            arg(A).val() , arg(A).indx(),  arg(A).pntrb(),  arg(A).pntre(), 
+            arg(B).origin(), arg(B).strides()[0], 
+            Type(beta), 
+            std::forward<MultiArray2DC>(C).origin(), std::forward<MultiArray2DC>(C).strides()[0]);
+
+        return std::forward<MultiArray2DC>(C);
+}
+
+// sliced ELLPACK matrix-MultiArray interface 
+template<class T, class SparseMatrixA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                SparseMatrixA::dimensionality == -4 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void // TODO change to use dispatch 
+>
+MultiArray2DC product(T alpha, SparseMatrixA const& A, MultiArray2DB const& B, T beta, MultiArray2DC&& C){
+        assert(op_tag<MultiArray2DB>::value == 'N');
+        assert( arg(B).strides()[1] == 1 );
+        assert( std::forward<MultiArray2DC>(C).strides()[1] == 1 );
+        if(op_tag<SparseMatrixA>::value == 'N') {
+            assert(arg(A).rows() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(A).cols() == arg(B).shape()[0]);
+            assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+        } else {
+            assert(arg(A).rows() == arg(B).shape()[0]);
+            assert(arg(A).cols() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+        }        
+
+        using Type = typename std::decay<decltype(*arg(A).val())>::type;
+        mySPBLAS::sellmm( op_tag<SparseMatrixA>::value, 
+            arg(A).rows(), arg(B).shape()[1], arg(A).cols(), arg(A).slice_height(), 
+            Type(alpha), 
+            arg(A).val() , arg(A).indx(),  arg(A).pntrb(),  arg(A).slice_length(), arg(A).row_permutation(), 
+            arg(B).origin(), arg(B).strides()[0], 
+            Type(beta), 
+            std::forward<MultiArray2DC>(C).origin(), std::forward<MultiArray2DC>(C).strides()[0],
+            arg(A).work_buffer(mySPBLAS::sellmm_work_size(arg(A).slice_height(),arg(B).shape()[1])));
+
+        return std::forward<MultiArray2DC>(C);
+}
+
+// sparse matrix with compressed indices-MultiArray interface 
+template<class T, class SparseMatrixA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                SparseMatrixA::dimensionality == -5 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void // TODO change to use dispatch 
+>
+MultiArray2DC product(T alpha, SparseMatrixA const& A, MultiArray2DB const& B, T beta, MultiArray2DC&& C){
+        assert(op_tag<MultiArray2DB>::value == 'N');
+        assert( arg(B).strides()[1] == 1 );
+        assert( std::forward<MultiArray2DC>(C).strides()[1] == 1 );
+        if(op_tag<SparseMatrixA>::value == 'N') {
+            assert(arg(A).rows() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(A).cols() == arg(B).shape()[0]);
+            assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+        } else {
+            assert(arg(A).rows() == arg(B).shape()[0]);
+            assert(arg(A).cols() == std::forward<MultiArray2DC>(C).shape()[0]);
+            assert(arg(B).shape()[1] == std::forward<MultiArray2DC>(C).shape()[1]);
+        }        
+
+        using Type = typename std::decay<decltype(*arg(A).val())>::type;
+        mySPBLAS::dcsrmm( op_tag<SparseMatrixA>::value, 
+            arg(A).rows(), arg(B).shape()[1], arg(A).cols(), 
+            Type(alpha), 
+            arg(A).val() , arg(A).delta(),  arg(A).base(),  arg(A).pntrb(), arg(A).pntre(), 
+            arg(B).origin(), arg(B).strides()[0], 
+            Type(beta), 
+            std::forward<MultiArray2DC>(C).origin(), std::forward<MultiArray2DC>(C).strides()[0]);
+
+        return std::forward<MultiArray2DC>(C);
+}
+
 template<class MultiArray2DA, class MultiArray2DB, class MultiArray2DC,
         typename = typename std::enable_if<
-                (MultiArray2DA::dimensionality == 2 or MultiArray2DA::dimensionality == -2) and
+                (MultiArray2DA::dimensionality == 2 or MultiArray2DA::dimensionality == -2 or MultiArray2DA::dimensionality == -3 or MultiArray2DA::dimensionality == -4 or MultiArray2DA::dimensionality == -5) and
                 MultiArray2DB::dimensionality == 2 and
                 std::decay<MultiArray2DC>::type::dimensionality == 2
         >::type
@@ -235,6 +350,68 @@ template<class MA2D> auto herm(MA2D&& arg)
 //	return normal(std::forward<MA2D>(arg));
 //}
 
+// applies the operation Op of a tagged argument to a matrix
+template<char Op> struct op_apply{};
+template<> struct op_apply<'N'>{
+	template<class M> static M const& apply(M const& m){return m;}
+};
+template<> struct op_apply<'T'>{
+	template<class M> static transpose_tag<M const&> apply(M const& m){return transposed(m);}
+};
+template<> struct op_apply<'H'>{
+	template<class M> static hermitian_tag<M const&> apply(M const& m){return hermitian(m);}
+};
+
+// calls product on the matrix referenced by a runtime dispatched matrix
+template<char Op, class T, class MultiArray2DB, class MultiArray2DC>
+struct product_visitor{
+	typedef void result_type;
+	T alpha;
+	MultiArray2DB const& B;
+	T beta;
+	MultiArray2DC& C;
+	product_visitor(T a, MultiArray2DB const& b, T bt, MultiArray2DC& c):alpha(a),B(b),beta(bt),C(c){}
+	template<class MatrixA> void operator()(MatrixA const* A) const{
+		assert(A != nullptr);
+		product(alpha, op_apply<Op>::apply(*A), B, beta, C);
+	}
+};
+
+// runtime dispatched matrix-MultiArray interface, e.g. MatrixOperator 
+template<class T, class MatrixA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                MatrixA::dimensionality == -6 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void, // TODO change to use dispatch 
+        typename = void // TODO change to use dispatch 
+>
+MultiArray2DC product(T alpha, MatrixA const& A, MultiArray2DB const& B, T beta, MultiArray2DC&& C){
+        // dense kernels need the scalars in the type of the matrices 
+        using Type = typename std::decay<MultiArray2DC>::type::element;
+        arg(A).apply( product_visitor<op_tag<MatrixA>::value, Type, MultiArray2DB, MultiArray2DC>(
+            Type(alpha), B, Type(beta), C) );
+        return std::forward<MultiArray2DC>(C);
+}
+
+template<class MatrixA, class MultiArray2DB, class MultiArray2DC,
+        typename = typename std::enable_if<
+                MatrixA::dimensionality == -6 and
+                MultiArray2DB::dimensionality == 2 and
+                std::decay<MultiArray2DC>::type::dimensionality == 2
+        >::type,
+        typename = void, // TODO change to use dispatch 
+        typename = void // TODO change to use dispatch 
+>
+MultiArray2DC product(MatrixA const& A, MultiArray2DB const& B, MultiArray2DC&& C){
+	return product(1., A, B, 0., std::forward<MultiArray2DC>(C));
+}
+
 
 template<class MultiArray2D>
 int invert_optimal_workspace_size(MultiArray2D const& m){
@@ -273,6 +450,42 @@ MultiArray2D invert(MultiArray2D&& m){
 	return std::forward<MultiArray2D>(m);
 }
 
+// determinant of a matrix from its LU factorization, m and pivot as returned by getrf
+template<class MultiArray2D, class MultiArray1D, class T = typename std::decay<MultiArray2D>::type::element>
+T lu_determinant(MultiArray2D const& m, MultiArray1D const& pivot){
+	T detvalue(1.0);
+	for(int i=0,ip=1,m_=m.shape()[0]; i<m_; i++, ip++){
+		if(pivot[i]==ip){
+			detvalue *= static_cast<T>(m[i][i]);
+		}else{
+			detvalue *= -static_cast<T>(m[i][i]);
+		}
+	}
+	return detvalue;
+}
+
+// B = inverse(A) * B, with m and pivot the LU factorization of A returned by getrf. 
+// Uses triangular solves (trsm) and row interchanges, the inverse is not formed.
+// The factorization of the row major matrix A is the one of T(A) in column major, 
+// so the solves are done from the right on T(B): T(B) = T(B) * inverse(U) * inverse(L) * inverse(P).
+template<class MultiArray2DA, class MultiArray1D, class MultiArray2DB>
+MultiArray2DB lu_solve(MultiArray2DA const& m, MultiArray1D const& pivot, MultiArray2DB&& B){
+	assert(m.shape()[0] == m.shape()[1]);
+	assert(m.shape()[0] == B.shape()[0]);
+	assert(pivot.size() >= m.shape()[0]);
+	assert(m.strides()[1] == 1);
+	assert(B.strides()[1] == 1);
+	using T = typename std::decay<MultiArray2DB>::type::element;
+	int n = m.shape()[0];
+	int nrhs = B.shape()[1];
+	BLAS::trsm('R', 'U', 'N', 'N', nrhs, n, T(1.0), m.origin(), m.strides()[0], B.origin(), B.strides()[0]);
+	BLAS::trsm('R', 'L', 'N', 'U', nrhs, n, T(1.0), m.origin(), m.strides()[0], B.origin(), B.strides()[0]);
+	for(int i=n-1; i>=0; i--) 
+		if(pivot[i]-1 != i) 
+			std::swap_ranges(B[i].begin(), B[i].end(), B[pivot[i]-1].begin()); 
+	return std::forward<MultiArray2DB>(B);
+}
+
 template<class MultiArray2D, class MultiArray1D, class T = typename std::decay<MultiArray2D>::type::element>
 T determinant(MultiArray2D&& m, MultiArray1D&& pivot){
 	assert(m.shape()[0] == m.shape()[1]);
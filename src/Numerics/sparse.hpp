@@ -21,21 +21,24 @@
 #include "Numerics/spblas.hpp"
 #include<cassert>
 #include<complex>
+#include<algorithm>
+#include<vector>
+#include<cstdint>
 
 struct mySPBLAS
 {
  
-  template<typename T>
+  template<typename T, typename P>
   inline static
-  void csrmv(const char transa, const int M, const int K, const T alpha, const char *matdescra, const T* A, const int* indx, const int *pntrb, const int *pntre, const T* x, const T beta, T *y  )
+  void csrmv(const char transa, const int M, const int K, const T alpha, const char *matdescra, const T* A, const int* indx, const P *pntrb, const P *pntre, const T* x, const T beta, T *y  )
   {
     assert(matdescra[0]=='G' && (matdescra[3]=='C' || matdescra[3]=='F'));
     int disp = (matdescra[3]=='C')?0:-1;
-    int p0 = *pntrb;
+    P p0 = *pntrb;
     if(transa=='n' || transa=='N') {  
       for(int nr=0; nr<M; nr++,y++,pntrb++,pntre++) {
         (*y) *= beta;
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           *y += alpha * (*(A+i)) * ( *( x + (*(indx+i)) + disp) );
         }
@@ -44,7 +47,7 @@ struct mySPBLAS
       for(int k=0; k<K; k++) 
         (*(y+k)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,x++) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           *(y+(*(indx+i))+disp) += alpha * (*(A+i)) * (*x);
         }
@@ -53,7 +56,7 @@ struct mySPBLAS
       for(int k=0; k<K; k++)
         (*(y+k)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,x++) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*indx+disp >= K) continue;
           *(y+(*(indx+i))+disp) += alpha * (*(A+i)) * (*x);
         }
@@ -61,17 +64,17 @@ struct mySPBLAS
     }
   }
 
-  template<typename T>
+  template<typename T, typename P>
   inline static
-  void csrmv(const char transa, const int M, const int K, const std::complex<T> alpha, const char *matdescra, const std::complex<T>* A, const int* indx, const int *pntrb, const int *pntre, const std::complex<T>* x, const std::complex<T> beta, std::complex<T> *y  )
+  void csrmv(const char transa, const int M, const int K, const std::complex<T> alpha, const char *matdescra, const std::complex<T>* A, const int* indx, const P *pntrb, const P *pntre, const std::complex<T>* x, const std::complex<T> beta, std::complex<T> *y  )
   {
     assert(matdescra[0]=='G' && (matdescra[3]=='C')); // || matdescra[3]=='F'));
     int disp = (matdescra[3]=='C')?0:-1;
-    int p0 = *pntrb;
+    P p0 = *pntrb;
     if(transa=='n' || transa=='N') {
       for(int nr=0; nr<M; nr++,y++,pntrb++,pntre++) {
         (*y) *= beta;
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           *y += alpha * (*(A+i)) * ( *( x + (*(indx+i)) + disp) );
         }
@@ -80,7 +83,7 @@ struct mySPBLAS
       for(int k=0; k<K; k++)
         (*(y+k)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,x++) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           *(y+(*(indx+i))+disp) += alpha * (*(A+i)) * (*x);
         }
@@ -89,7 +92,7 @@ struct mySPBLAS
       for(int k=0; k<K; k++)
         (*(y+k)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,x++) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*indx+disp >= K) continue;
           *(y+(*(indx+i))+disp) += alpha * std::conj(*(A+i)) * (*x);
         }
@@ -97,18 +100,18 @@ struct mySPBLAS
     }
   }
 
-  template<typename T>
+  template<typename T, typename P>
   inline static
-  void csrmm(const char transa, const int M, const int N, const int K, const T alpha, const char *matdescra, const T *A, const int *indx, const int *pntrb, const int *pntre, const T *B, const int ldb, const T beta, T *C, const int ldc)
+  void csrmm(const char transa, const int M, const int N, const int K, const T alpha, const char *matdescra, const T *A, const int *indx, const P *pntrb, const P *pntre, const T *B, const int ldb, const T beta, T *C, const int ldc)
   {
     assert(matdescra[0]=='G' && (matdescra[3]=='C')); // || matdescra[3]=='F'));
-    int p0 = *pntrb;
+    P p0 = *pntrb;
     int disp = (matdescra[3]=='C')?0:-1;
     if(transa=='n' || transa=='N') {
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,C+=ldc) {
         for(int i=0; i<N; i++)
           (*(C+i)) *= beta;
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           // at this point *(A+i) is A_rc, c=*(indx+i)+disp, *C is C(r,0)
           // C(r,:) = A_rc * B(c,:)
@@ -125,7 +128,7 @@ struct mySPBLAS
        for(int j=0; j<N; j++)
         (*(C+i*ldc+j)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++, B+=ldb) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++, B+=ldb) {
           if(*(indx+i)+disp >= K) continue;
           // at this point *(A+i) is A_rc, c=*(indx+i)+disp
           // C(c,:) = A_rc * B(r,:)
@@ -142,7 +145,7 @@ struct mySPBLAS
        for(int j=0; j<N; j++)
         (*(C+i*ldc+j)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++, B+=ldb) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++, B+=ldb) {
           if(*(indx+i)+disp >= K) continue;
           // at this point *(A+i) is A_rc, c=*(indx+i)+disp
           // C(c,:) = A_rc * B(r,:)
@@ -156,18 +159,18 @@ struct mySPBLAS
     }
   }
 
-  template<typename T>
+  template<typename T, typename P>
   inline static
-  void csrmm(const char transa, const int M, const int N, const int K, const std::complex<T> alpha, const char *matdescra, const std::complex<T> *A, const int *indx, const int *pntrb, const int *pntre, const std::complex<T> *B, const int ldb, const std::complex<T> beta, std::complex<T> *C, const int ldc)
+  void csrmm(const char transa, const int M, const int N, const int K, const std::complex<T> alpha, const char *matdescra, const std::complex<T> *A, const int *indx, const P *pntrb, const P *pntre, const std::complex<T> *B, const int ldb, const std::complex<T> beta, std::complex<T> *C, const int ldc)
   {
     assert(matdescra[0]=='G' && (matdescra[3]=='C')); // || matdescra[3]=='F'));
     int disp = (matdescra[3]=='C')?0:-1;
-    int p0 = *pntrb;
+    P p0 = *pntrb;
     if(transa=='n' || transa=='N') {
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,C+=ldc) {
         for(int i=0; i<N; i++)
           (*(C+i)) *= beta;
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           // at this point *(A+i) is A_rc, c=*(indx+i)+disp, *C is C(r,0)
           // C(r,:) = A_rc * B(c,:)
@@ -184,7 +187,7 @@ struct mySPBLAS
        for(int j=0; j<N; j++)
         (*(C+i*ldc+j)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++,B+=ldb) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           // at this point *(A+i) is A_rc, c=*(indx+i)+disp
           // C(c,:) = A_rc * B(r,:)
@@ -201,7 +204,7 @@ struct mySPBLAS
        for(int j=0; j<N; j++)
         (*(C+i*ldc+j)) *= beta;
       for(int nr=0; nr<M; nr++,pntrb++,pntre++, B+=ldb) {
-        for(int i=*pntrb-p0; i<*pntre-p0; i++) {
+        for(P i=*pntrb-p0; i<*pntre-p0; i++) {
           if(*(indx+i)+disp >= K) continue;
           // at this point *(A+i) is A_rc, c=*(indx+i)+disp
           // C(c,:) = A_rc * B(r,:)
@@ -215,6 +218,269 @@ struct mySPBLAS
     }
   }
 
+  /**
+   * C = alpha * op(A) * B + beta * C, with A in block-CSR (BSR) format with square blocks
+   * of dimension [bs x bs], stored in row-major order with 0-based (C) indexing.
+   * M and K are the number of rows and columns of A (not the number of blocks).
+   * Blocks on the edges of A can extend beyond [M x K], padded values are ignored.
+   */
+  template<typename T>
+  inline static
+  void bsrmm(const char transa, const int M, const int N, const int K, const int bs, const T alpha, const T *A, const int *indx, const int *pntrb, const int *pntre, const T *B, const int ldb, const T beta, T *C, const int ldc)
+  {
+    // the most common block sizes are specialized, so the loops over the block are unrolled
+    switch(bs) {
+      case 1:
+        bsrmm_<1>(transa,M,N,K,bs,alpha,A,indx,pntrb,pntre,B,ldb,beta,C,ldc);
+        break;
+      case 2:
+        bsrmm_<2>(transa,M,N,K,bs,alpha,A,indx,pntrb,pntre,B,ldb,beta,C,ldc);
+        break;
+      case 4:
+        bsrmm_<4>(transa,M,N,K,bs,alpha,A,indx,pntrb,pntre,B,ldb,beta,C,ldc);
+        break;
+      case 8:
+        bsrmm_<8>(transa,M,N,K,bs,alpha,A,indx,pntrb,pntre,B,ldb,beta,C,ldc);
+        break;
+      default:
+        bsrmm_<0>(transa,M,N,K,bs,alpha,A,indx,pntrb,pntre,B,ldb,beta,C,ldc);
+        break;
+    }
+  }
+
+  // tile of the columns of B in sellmm: all columns up to 256, so A is read only once in most cases
+  inline static int sellmm_tile(const int N)
+  {
+    return std::min(N,256);
+  }
+
+  // number of elements of the work buffer of sellmm, with slices of S rows and N columns in B
+  inline static std::size_t sellmm_work_size(const int S, const int N)
+  {
+    return std::size_t(S)*sellmm_tile(N);
+  }
+
+  /**
+   * C = alpha * op(A) * B + beta * C, with A in SELL-C-sigma format with slices of S rows
+   * (see SlicedEllMatrix). M and K are the number of rows and columns of A, sptr/slen are
+   * the offset and number of stored columns of each slice and perm the original index of
+   * the sorted rows. Columns of B and C are processed in tiles, the rows of a slice are
+   * accumulated in the work buffer and C is written only once per tile.
+   * work holds sellmm_work_size(S,N) elements, it is not used with op(A) = T(A) or H(A).
+   */
+  template<typename T>
+  inline static
+  void sellmm(const char transa, const int M, const int N, const int K, const int S, const T alpha, const T *A, const int *indx, const int *sptr, const int *slen, const int *perm, const T *B, const int ldb, const T beta, T *C, const int ldc, T *work)
+  {
+    const int NS = (M+S-1)/S;
+    if(transa=='n' || transa=='N') {
+      const int NT = sellmm_tile(N);
+      T* acc = work;
+      for(int s=0; s<NS; s++) {
+        const int nr = std::min(S,M-s*S);
+        const T* As = A+sptr[s];
+        const int* Is = indx+sptr[s];
+        const int* Ps = perm+s*S;
+        for(int k0=0; k0<N; k0+=NT) {
+          const int nk = std::min(NT,N-k0);
+          std::fill(acc,acc+S*NT,T(0));
+          for(int j=0; j<slen[s]; j++) {
+            for(int r=0; r<nr; r++) {
+              const T a = As[j*S+r];
+              const T* Bc = B+Is[j*S+r]*ldb+k0;
+              T* ar = acc+r*NT;
+              if(nk==NT) {
+                for(int k=0; k<NT; k++)
+                  ar[k] += a*Bc[k];
+              } else {
+                for(int k=0; k<nk; k++)
+                  ar[k] += a*Bc[k];
+              }
+            }
+          }
+          for(int r=0; r<nr; r++) {
+            T* Cr = C+Ps[r]*ldc+k0;
+            const T* ar = acc+r*NT;
+            for(int k=0; k<nk; k++)
+              Cr[k] = beta*Cr[k] + alpha*ar[k];
+          }
+        }
+      }
+    } else if(transa=='t' || transa=='T' || transa=='h' || transa=='H') {
+      const bool cnj = (transa=='h' || transa=='H');
+      for(int i=0; i<K; i++)
+       for(int j=0; j<N; j++)
+        (*(C+i*ldc+j)) *= beta;
+      for(int s=0; s<NS; s++) {
+        const int nr = std::min(S,M-s*S);
+        const T* As = A+sptr[s];
+        const int* Is = indx+sptr[s];
+        const int* Ps = perm+s*S;
+        for(int j=0; j<slen[s]; j++) {
+          for(int r=0; r<nr; r++) {
+            const T a = As[j*S+r];
+            if(a==T(0)) continue;  // padding
+            const T Arc = alpha*(cnj?bsr_conj(a):a);
+            const T* Br = B+Ps[r]*ldb;
+            T* Cc = C+Is[j*S+r]*ldc;
+            for(int k=0; k<N; k++)
+              Cc[k] += Arc*Br[k];
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * C = alpha * op(A) * B + beta * C, with A in CSR format with compressed column indices
+   * (see DeltaSparseMatrix). Column indices are decoded on the fly: the first element of row r
+   * is in column base[r], each element is delta[i] columns to the right of the previous one.
+   */
+  template<typename T>
+  inline static
+  void dcsrmm(const char transa, const int M, const int N, const int K, const T alpha, const T *A, const uint16_t *delta, const int *base, const int *pntrb, const int *pntre, const T *B, const int ldb, const T beta, T *C, const int ldc)
+  {
+    int p0 = *pntrb;
+    if(transa=='n' || transa=='N') {
+      for(int nr=0; nr<M; nr++,C+=ldc) {
+        for(int i=0; i<N; i++)
+          (*(C+i)) *= beta;
+        int c = base[nr];
+        for(int i=pntrb[nr]-p0; i<pntre[nr]-p0; i++) {
+          c += delta[i];
+          // C(r,:) = A_rc * B(c,:)
+          const T* Bc = B+ldb*c;
+          T* Cr = C;
+          T Arc = alpha*A[i];
+          for(int k=0; k<N; k++, Cr++, Bc++)
+            *Cr += Arc * (*Bc);
+        }
+      }
+    } else if(transa=='t' || transa=='T' || transa=='h' || transa=='H') {
+      const bool cnj = (transa=='h' || transa=='H');
+      for(int i=0; i<K; i++)
+       for(int j=0; j<N; j++)
+        (*(C+i*ldc+j)) *= beta;
+      for(int nr=0; nr<M; nr++,B+=ldb) {
+        int c = base[nr];
+        for(int i=pntrb[nr]-p0; i<pntre[nr]-p0; i++) {
+          c += delta[i];
+          // C(c,:) = A_rc * B(r,:)
+          const T* Br = B;
+          T* Cc = C+ldc*c;
+          T Arc = alpha*(cnj?bsr_conj(A[i]):A[i]);
+          for(int k=0; k<N; k++, Cc++, Br++)
+            *Cc += Arc * (*Br);
+        }
+      }
+    }
+  }
+
+  private:
+
+  template<typename T>
+  inline static T bsr_conj(const T& a) { return a; }
+  template<typename T>
+  inline static std::complex<T> bsr_conj(const std::complex<T>& a) { return std::conj(a); }
+
+  // BS>0 fixes the block size at compile time, BS==0 uses bs
+  template<int BS, typename T>
+  inline static
+  void bsrmm_(const char transa, const int M, const int N, const int K, const int bs, const T alpha, const T *A, const int *indx, const int *pntrb, const int *pntre, const T *B, const int ldb, const T beta, T *C, const int ldc)
+  {
+    const int b = (BS>0)?BS:bs;
+    const int b2 = b*b;
+    const int MB = (M+b-1)/b;
+    int p0 = *pntrb;
+    if(transa=='n' || transa=='N') {
+      for(int i=0; i<M; i++)
+       for(int j=0; j<N; j++)
+        (*(C+i*ldc+j)) *= beta;
+      for(int I=0; I<MB; I++) {
+        const int r0 = I*b;
+        const int nr = std::min(b,M-r0);
+        for(int p=pntrb[I]-p0; p<pntre[I]-p0; p++) {
+          const int c0 = indx[p]*b;
+          const T* blk = A+p*b2;
+          const T* Bc = B+c0*ldb;
+          // C(r0+r,:) += alpha * sum_c A_rc * B(c0+c,:)
+          if(c0+b <= K) {
+            for(int r=0; r<nr; r++) {
+              const T* ar = blk+r*b;
+              T* Cr = C+(r0+r)*ldc;
+              for(int k=0; k<N; k++) {
+                T s(0);
+                for(int c=0; c<b; c++)
+                  s += ar[c] * Bc[c*ldb+k];
+                Cr[k] += alpha*s;
+              }
+            }
+          } else {
+            const int nc = K-c0;
+            for(int r=0; r<nr; r++) {
+              const T* ar = blk+r*b;
+              T* Cr = C+(r0+r)*ldc;
+              for(int k=0; k<N; k++) {
+                T s(0);
+                for(int c=0; c<nc; c++)
+                  s += ar[c] * Bc[c*ldb+k];
+                Cr[k] += alpha*s;
+              }
+            }
+          }
+        }
+      }
+    } else if(transa=='t' || transa=='T' || transa=='h' || transa=='H') {
+      const bool cnj = (transa=='h' || transa=='H');
+      for(int i=0; i<K; i++)
+       for(int j=0; j<N; j++)
+        (*(C+i*ldc+j)) *= beta;
+      for(int I=0; I<MB; I++) {
+        const int r0 = I*b;
+        const T* Br = B+r0*ldb;
+        for(int p=pntrb[I]-p0; p<pntre[I]-p0; p++) {
+          const int c0 = indx[p]*b;
+          const int nc = std::min(b,K-c0);
+          const T* blk = A+p*b2;
+          // C(c0+c,:) += alpha * sum_r op(A_rc) * B(r0+r,:)
+          if(r0+b <= M) {
+            for(int c=0; c<nc; c++) {
+              T ac[(BS>0)?BS:1];
+              const T* a = blk+c;
+              if(BS>0)
+                for(int r=0; r<b; r++)
+                  ac[r] = cnj?bsr_conj(a[r*b]):a[r*b];
+              T* Cc = C+(c0+c)*ldc;
+              for(int k=0; k<N; k++) {
+                T s(0);
+                if(BS>0) {
+                  for(int r=0; r<b; r++)
+                    s += ac[r] * Br[r*ldb+k];
+                } else {
+                  for(int r=0; r<b; r++)
+                    s += (cnj?bsr_conj(a[r*b]):a[r*b]) * Br[r*ldb+k];
+                }
+                Cc[k] += alpha*s;
+              }
+            }
+          } else {
+            const int nr = M-r0;
+            for(int c=0; c<nc; c++) {
+              const T* a = blk+c;
+              T* Cc = C+(c0+c)*ldc;
+              for(int k=0; k<N; k++) {
+                T s(0);
+                for(int r=0; r<nr; r++)
+                  s += (cnj?bsr_conj(a[r*b]):a[r*b]) * Br[r*ldb+k];
+                Cc[k] += alpha*s;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
 };
 
 #if defined(HAVE_MKL)
@@ -307,6 +573,22 @@ struct SPBLAS
 #endif
   }
 
+  // 64-bit row pointers are not supported by the LP64 interface of MKL, 
+  // the generic routines are used in this case
+  template<typename T, typename Tab>
+  inline static
+  void csrmv(const char transa, const int M, const int K, const Tab alpha, const char *matdescra, const T *A, const int* indx, const long *pntrb, const long *pntre, const T *x, const Tab beta, T *y  )
+  {
+    mySPBLAS::csrmv(transa,M,K,T(alpha),matdescra,A,indx,pntrb,pntre,x,T(beta),y);
+  }
+
+  template<typename T, typename Tab>
+  inline static
+  void csrmm(const char transa, const int M, const int N, const int K, const Tab alpha, const char *matdescra, const T *A, const int *indx, const long *pntrb, const long *pntre, const T *B, const int ldb, const Tab beta, T *C, const int ldc)
+  {
+    mySPBLAS::csrmm(transa,M,N,K,T(alpha),matdescra,A,indx,pntrb,pntre,B,ldb,T(beta),C,ldc);
+  }
+
 };
 
 
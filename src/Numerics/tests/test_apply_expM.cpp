@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// apply_expM_batched (Horner form, batched gemm) compared with apply_expM applied to every
+// matrix of the batch, for several orders of the expansion.
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include <complex>
+#include <random>
+#include <boost/multi_array.hpp>
+
+#include "AFQMC/vHS.hpp"
+
+using std::complex;
+
+namespace qmcplusplus
+{
+
+typedef complex<double> Type;
+typedef boost::multi_array<Type,2> Matrix;
+typedef boost::multi_array<Type,3> Matrix3D;
+
+template<class Array>
+void fill_random(Array& A, double scale, std::mt19937& gen)
+{
+  std::uniform_real_distribution<double> dist(-scale,scale);
+  for(std::size_t i=0; i<A.num_elements(); i++)
+    A.data()[i] = Type(dist(gen),dist(gen));
+}
+
+TEST_CASE("apply_expM_batched", "[afqmc_vHS]")
+{
+  std::mt19937 gen(11);
+  // the columns of S hold both spins of a walker, as in the walker-major propagation
+  const int nbatch = 3, M = 7, N = 6;
+  Matrix3D V(boost::extents[nbatch][M][M]);
+  Matrix3D S0(boost::extents[nbatch][M][N]);
+  fill_random(V,0.2,gen);
+  fill_random(S0,1.0,gen);
+
+  for(int order: {1,2,3,6}) {
+    Matrix3D S(S0);
+    Matrix3D T1(boost::extents[nbatch][M][N]);
+    Matrix3D T2(boost::extents[nbatch][M][N]);
+    base::apply_expM_batched(V,S,T1,T2,order);
+
+    double diff = 0.0;
+    for(int nw=0; nw<nbatch; nw++) {
+      Matrix Vw(V[nw]);
+      Matrix Sw(S0[nw]);
+      Matrix W1(boost::extents[M][N]);
+      Matrix W2(boost::extents[M][N]);
+      base::apply_expM(Vw,Sw,W1,W2,order);
+      for(int i=0; i<M; i++)
+        for(int j=0; j<N; j++)
+          diff = std::max(diff,std::abs(S[nw][i][j]-Sw[i][j]));
+    }
+    REQUIRE(diff < 1e-12);
+  }
+}
+
+}
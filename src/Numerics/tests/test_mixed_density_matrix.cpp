@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// MixedDensityMatrix_LU (LU factorization and triangular solves) compared with MixedDensityMatrix
+// (explicit inverse), for the overlap and for G in compact and full form, and ma::lu_solve compared
+// with the product by the inverse.
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include <complex>
+#include <random>
+#include <vector>
+#include <boost/multi_array.hpp>
+
+#include "Numerics/ma_operations.hpp"
+#include "AFQMC/mixed_density_matrix.hpp"
+
+using std::complex;
+
+namespace qmcplusplus
+{
+
+typedef complex<double> Type;
+typedef boost::multi_array<Type,2> Matrix;
+
+void fill_random(Matrix& A, std::mt19937& gen)
+{
+  std::uniform_real_distribution<double> dist(-1.0,1.0);
+  for(std::size_t i=0; i<A.num_elements(); i++)
+    A.data()[i] = Type(dist(gen),dist(gen));
+}
+
+double max_difference(const Matrix& A, const Matrix& B)
+{
+  double diff = 0.0;
+  for(std::size_t i=0; i<A.num_elements(); i++)
+    diff = std::max(diff,std::abs(A.data()[i]-B.data()[i]));
+  return diff;
+}
+
+TEST_CASE("lu_solve", "[afqmc_density_matrix]")
+{
+  std::mt19937 gen(7);
+  const int n = 9, nrhs = 5;
+  Matrix A(boost::extents[n][n]);
+  Matrix B(boost::extents[n][nrhs]);
+  fill_random(A,gen);
+  fill_random(B,gen);
+
+  // X = inverse(A) * B
+  Matrix Ainv(A);
+  std::vector<int> pivot(n);
+  ma::invert(Ainv,pivot);
+  Matrix Xref(boost::extents[n][nrhs]);
+  ma::product(Ainv,B,Xref);
+
+  Matrix LU(A);
+  Matrix X(B);
+  std::vector<int> pivot_lu(n);
+  ma::getrf(LU,pivot_lu);
+  ma::lu_solve(LU,pivot_lu,X);
+  REQUIRE(max_difference(X,Xref) < 1e-10);
+
+  Matrix Acopy(A);
+  std::vector<int> pivot_det(n);
+  Type det = ma::determinant(Acopy,pivot_det);
+  REQUIRE(std::abs(ma::lu_determinant(LU,pivot_lu)-det) < 1e-10*std::abs(det));
+}
+
+TEST_CASE("mixed_density_matrix_LU", "[afqmc_density_matrix]")
+{
+  std::mt19937 gen(13);
+  const int NMO = 10, NEL = 4;
+  Matrix conjA(boost::extents[NMO][NEL]);
+  Matrix B(boost::extents[NMO][NEL]);
+  fill_random(conjA,gen);
+  fill_random(B,gen);
+
+  Matrix T1(boost::extents[NEL][NEL]);
+  Matrix T2(boost::extents[NEL][NMO]);
+  std::vector<int> IWORK(NMO);
+  std::vector<Type> WORK;
+  WORK.reserve(ma::getri_optimal_workspace_size(T1));
+
+  for(bool compact: {true,false}) {
+    const int N = compact?NEL:NMO;
+    Matrix Gref(boost::extents[N][NMO]);
+    Matrix G(boost::extents[N][NMO]);
+    Type ovlp_ref = base::MixedDensityMatrix<Type>(conjA,B,Gref,T1,T2,IWORK,WORK,compact);
+    Type ovlp = base::MixedDensityMatrix_LU<Type>(conjA,B,G,T1,T2,IWORK,compact);
+    REQUIRE(std::abs(ovlp-ovlp_ref) < 1e-12*std::abs(ovlp_ref));
+    REQUIRE(max_difference(G,Gref) < 1e-10);
+  }
+}
+
+}
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source License.
+// See LICENSE file in top directory for details.
+//
+// Copyright (c) 2017 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//
+// File created by: Miguel A. Morales, moralessilva2@llnl.gov, Lawrence Livermore National Laboratory
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Products of the bsr, sell and dcsr formats compared with csrmm, for op(A) = A, T(A) and H(A).
+// Block and slice sizes do not divide the dimensions of the matrices, and some rows and
+// columns are empty.
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "Configuration.h"
+
+#include <complex>
+#include <random>
+#include <vector>
+#include <boost/multi_array.hpp>
+
+#include "Matrix/SparseMatrix.hpp"
+#include "Matrix/BlockSparseMatrix.hpp"
+#include "Matrix/SlicedEllMatrix.hpp"
+#include "Matrix/DeltaSparseMatrix.hpp"
+#include "Numerics/ma_operations.hpp"
+
+using std::complex;
+
+namespace qmcplusplus
+{
+
+typedef complex<double> Type;
+typedef boost::multi_array<Type,2> Matrix;
+
+// M x K matrix with a fraction of non-zeros, rows and columns in the empty lists stay empty
+void make_sparse(int M, int K, double fill, const std::vector<int>& empty_rows, const std::vector<int>& empty_cols,
+                 std::mt19937& gen, SparseMatrix<Type>& A)
+{
+  std::uniform_real_distribution<double> dist(-1.0,1.0);
+  A.setDims(M,K);
+  for(int i=0; i<M; i++) {
+    if(std::find(empty_rows.begin(),empty_rows.end(),i) != empty_rows.end()) continue;
+    for(int j=0; j<K; j++) {
+      if(std::find(empty_cols.begin(),empty_cols.end(),j) != empty_cols.end()) continue;
+      if(0.5*(dist(gen)+1.0) < fill)
+        A.add(i,j,Type(dist(gen),dist(gen)));
+    }
+  }
+  A.compress();
+}
+
+void make_dense(int M, int N, std::mt19937& gen, Matrix& B)
+{
+  std::uniform_real_distribution<double> dist(-1.0,1.0);
+  B.resize(boost::extents[M][N]);
+  for(int i=0; i<M; i++)
+    for(int j=0; j<N; j++)
+      B[i][j] = Type(dist(gen),dist(gen));
+}
+
+double max_difference(const Matrix& A, const Matrix& B)
+{
+  double diff = 0.0;
+  for(std::size_t i=0; i<A.num_elements(); i++)
+    diff = std::max(diff,std::abs(A.data()[i]-B.data()[i]));
+  return diff;
+}
+
+// C = alpha * op(A) * B + beta * C with csrmm, for op = 'N', 'T' or 'H'
+void reference_product(char op, Type alpha, const SparseMatrix<Type>& A, const Matrix& B, Type beta, Matrix& C)
+{
+  mySPBLAS::csrmm(op, A.rows(), B.shape()[1], A.cols(), alpha, "GxxCxx",
+                  A.val(), A.indx(), A.pntrb(), A.pntre(),
+                  B.origin(), B.strides()[0], beta, C.origin(), C.strides()[0]);
+}
+
+// compares the products of the matrix Asp, in any format, with the products of the csr matrix A
+template<class SpMat>
+void check_products(const SparseMatrix<Type>& A, const SpMat& Asp, int N, std::mt19937& gen)
+{
+  using ma::T;
+  using ma::H;
+  const Type alpha(0.7,-0.2), beta(0.3,0.4);
+  Matrix B, Bt, C0, Ct0;
+  make_dense(A.cols(),N,gen,B);
+  make_dense(A.rows(),N,gen,Bt);
+  make_dense(A.rows(),N,gen,C0);
+  make_dense(A.cols(),N,gen,Ct0);
+
+  Matrix Cref(C0), C(C0);
+  reference_product('N',alpha,A,B,beta,Cref);
+  ma::product(alpha,Asp,B,beta,C);
+  REQUIRE(max_difference(C,Cref) < 1e-12);
+
+  Matrix Ctref(Ct0), Ct(Ct0);
+  reference_product('T',alpha,A,Bt,beta,Ctref);
+  ma::product(alpha,T(Asp),Bt,beta,Ct);
+  REQUIRE(max_difference(Ct,Ctref) < 1e-12);
+
+  Ctref = Ct0;
+  Ct = Ct0;
+  reference_product('H',alpha,A,Bt,beta,Ctref);
+  ma::product(alpha,H(Asp),Bt,beta,Ct);
+  REQUIRE(max_difference(Ct,Ctref) < 1e-12);
+}
+
+TEST_CASE("sparse_formats_bsr", "[sparse_formats]")
+{
+  std::mt19937 gen(17);
+  SparseMatrix<Type> A;
+  make_sparse(13,11,0.3,{0,5,12},{3},gen,A);
+  // specialized (1, 2, 4, 8) and generic block sizes
+  for(int bs: {1,2,3,4,5,8}) {
+    BlockSparseMatrix<Type> Abs;
+    Abs.initFrom(A,bs);
+    for(int N: {1,7})
+      check_products(A,Abs,N,gen);
+  }
+}
+
+TEST_CASE("sparse_formats_sell", "[sparse_formats]")
+{
+  std::mt19937 gen(23);
+  SparseMatrix<Type> A;
+  make_sparse(13,11,0.3,{0,5,12},{3},gen,A);
+  for(int c: {1,3,5}) {
+    for(int sigma: {1,4}) {
+      SlicedEllMatrix<Type> Asell;
+      Asell.initFrom(A,c,sigma*c);
+      // more than one tile of 256 columns of B
+      for(int N: {1,7,300})
+        check_products(A,Asell,N,gen);
+    }
+  }
+}
+
+TEST_CASE("sparse_formats_dcsr", "[sparse_formats]")
+{
+  std::mt19937 gen(31);
+  {
+    SparseMatrix<Type> A;
+    make_sparse(13,11,0.3,{0,5,12},{3},gen,A);
+    DeltaSparseMatrix<Type> Ad;
+    Ad.initFrom(A);
+    for(int N: {1,7})
+      check_products(A,Ad,N,gen);
+  }
+  {
+    // column gaps larger than the range of the deltas are bridged with explicit zeros
+    const int K = 200000;
+    SparseMatrix<Type> A;
+    A.setDims(4,K);
+    A.add(0,0,Type(1.0,0.5));
+    A.add(0,K-1,Type(-0.5,2.0));
+    A.add(2,70000,Type(0.25,-1.0));
+    A.add(2,140001,Type(3.0,0.0));
+    A.add(3,K-1,Type(0.0,1.5));
+    A.compress();
+    DeltaSparseMatrix<Type> Ad;
+    Ad.initFrom(A);
+    REQUIRE(Ad.size() > A.size());
+    check_products(A,Ad,3,gen);
+  }
+}
+
+}
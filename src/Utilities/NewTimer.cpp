@@ -30,6 +30,9 @@
 #include <map>
 #include <limits>
 #include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
 
 namespace qmcplusplus
 {
@@ -70,6 +73,8 @@ void TimerManagerClass::addTimer(NewTimer *t)
     {
       t->set_id(timer_name_to_id[t->get_name()]);
     }
+    if (CurrentTimerStack.size() < t->num_threads())
+      CurrentTimerStack.resize(t->num_threads());
     t->set_manager(this);
     t->set_active_by_timer_threshold(timer_threshold);
     TimerList.push_back(t);
@@ -84,6 +89,92 @@ NewTimer *TimerManagerClass::createTimer(const std::string &myname,
   return t;
 }
 
+int TimerManagerClass::enable_hardware_counters()
+{
+  int navail       = counters.open();
+  counters_enabled = navail > 0;
+  if (!counters_enabled) counters.close();
+  return navail;
+}
+
+void TimerManagerClass::disable_hardware_counters()
+{
+  counters.close();
+  counters_enabled = false;
+}
+
+void TimerManagerClass::enable_trace(long capacity, int rank)
+{
+  int nthreads = std::max(static_cast<int>(CurrentTimerStack.size()),
+                          static_cast<int>(omp_get_max_threads()));
+  trace_buffer.assign(nthreads,
+                      std::vector<TimerTraceEvent>(std::max(capacity, 1l)));
+  trace_count.assign(nthreads, 0);
+  trace_start   = cpu_clock();
+  trace_rank    = rank;
+  trace_enabled = true;
+}
+
+// escapes a string for a JSON string literal
+static std::string json_escape(const std::string &in)
+{
+  std::string out;
+  for (int i = 0; i < in.size(); i++)
+  {
+    if (in[i] == '"' || in[i] == '\\') out += '\\';
+    out += in[i];
+  }
+  return out;
+}
+
+bool TimerManagerClass::write_trace(const std::string &fname)
+{
+  std::ofstream out(fname.c_str());
+  if (!out) return false;
+  char buf[512];
+  out << "{\"displayTimeUnit\":\"ms\",\n\"traceEvents\":[\n";
+  snprintf(buf, sizeof(buf),
+           "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+           "\"args\":{\"name\":\"rank %d\"}}",
+           trace_rank, trace_rank);
+  out << buf;
+  long dropped = 0;
+  for (int tid = 0; tid < trace_buffer.size(); tid++)
+  {
+    const std::vector<TimerTraceEvent> &ring = trace_buffer[tid];
+    long count = trace_count[tid];
+    if (count == 0) continue;
+    snprintf(buf, sizeof(buf),
+             ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+             "\"args\":{\"name\":\"thread %d\"}}",
+             trace_rank, tid, tid);
+    out << buf;
+    long first = std::max(0l, count - static_cast<long>(ring.size()));
+    dropped += first;
+    // end events whose begin event was overwritten are skipped
+    int depth = 0;
+    for (long n = first; n < count; n++)
+    {
+      const TimerTraceEvent &e = ring[n % ring.size()];
+      if (e.phase == 'E')
+      {
+        if (depth == 0) continue;
+        depth--;
+      }
+      else
+        depth++;
+      snprintf(buf, sizeof(buf),
+               "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+               "\"args\":{\"step\":%d,\"substep\":%d}}",
+               e.phase, (e.time - trace_start) * 1e6, trace_rank, tid, e.step,
+               e.substep);
+      out << ",\n{\"name\":\"" << json_escape(timer_id_name[e.id]) << buf;
+    }
+  }
+  out << "\n],\n\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+  return bool(out);
+}
+
 void TimerManagerClass::reset()
 {
   for (int i = 0; i < TimerList.size(); i++)
@@ -111,12 +202,19 @@ void TimerManagerClass::collate_flat_profile(FlatProfileData &p)
       p.nameList[timer.get_name()] = ind;
       p.timeList.push_back(timer.get_total());
       p.callList.push_back(timer.get_num_calls());
+      p.counterList.push_back(timer.get_counters());
+      p.flopList.push_back(timer.get_flops());
+      p.byteList.push_back(timer.get_bytes());
     }
     else
     {
       int ind = (*it).second;
       p.timeList[ind] += timer.get_total();
       p.callList[ind] += timer.get_num_calls();
+      for (int j = 0; j < PerfCounters::num_counters; j++)
+        p.counterList[ind][j] += timer.get_counters()[j];
+      p.flopList[ind] += timer.get_flops();
+      p.byteList[ind] += timer.get_bytes();
     }
   }
 }
@@ -182,16 +280,26 @@ void TimerManagerClass::collate_stack_profile(StackProfileData &p)
   // map's keys will also place the stacks in depth-first order.
   // The order in which sibling timers are encountered in the code is not
   // preserved. They will be ordered alphabetically instead.
+  // The stacks of all the threads are included, with the maximum time and
+  // calls over the threads.
   std::map<std::string, ProfileData> all_stacks;
   for (int i = 0; i < TimerList.size(); ++i)
   {
     NewTimer &timer = *TimerList[i];
-    std::map<StackKey, double>::iterator stack_id_it =
-        timer.get_per_stack_total_time().begin();
-    for (; stack_id_it != timer.get_per_stack_total_time().end(); stack_id_it++)
+    std::map<StackKey, bool> keys;
+    for (int tid = 0; tid < timer.num_threads(); tid++)
+    {
+      std::map<StackKey, double>::iterator stack_id_it =
+          timer.get_per_stack_total_time(tid).begin();
+      for (; stack_id_it != timer.get_per_stack_total_time(tid).end();
+           stack_id_it++)
+        keys[stack_id_it->first] = true;
+    }
+    std::map<StackKey, bool>::iterator key_it = keys.begin();
+    for (; key_it != keys.end(); key_it++)
     {
       ProfileData pd;
-      const StackKey &key = stack_id_it->first;
+      const StackKey &key = key_it->first;
       std::string stack_name;
       get_stack_name_from_id(key, stack_name);
       pd.time  = timer.get_total(key);
@@ -241,6 +349,13 @@ void TimerManagerClass::print()
 #ifdef USE_STACK_TIMERS
   printf("Stack timer profile\n");
   print_stack();
+  if (counters_enabled)
+  {
+    printf("\nHardware counter profile\n");
+    print_counters();
+  }
+  print_roofline();
+  print_threads();
 #else
   printf("\nFlat profile\n");
   print_flat();
@@ -333,6 +448,324 @@ void TimerManagerClass::print_stack()
 #endif
 }
 
+void TimerManagerClass::print_counters()
+{
+#if ENABLE_TIMERS
+  FlatProfileData p;
+
+  collate_flat_profile(p);
+
+  int max_name_len = 5;
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+    max_name_len = std::max(max_name_len, static_cast<int>(it->first.size()));
+
+  for (int j = 0; j < PerfCounters::num_counters; j++)
+    if (!counters.available(j))
+      printf("Warning: Hardware counter %s is not available.\n",
+             PerfCounters::name(j));
+
+  // the memory traffic is estimated from the LLC misses
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-13s  %-13s  %-6s  %-12s  %-13s  %-11s\n", timer_name.c_str(),
+         "Cycles", "Instructions", "IPC", "LLC_miss_rate", "LLC_misses",
+         "LLC_GB/s");
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+  {
+    int i                          = it->second;
+    const PerfCounters::values_t &c = p.counterList[i];
+    if (p.callList[i] == 0) continue;
+    std::string padded_name_str;
+    pad_string(it->first, padded_name_str, max_name_len);
+    double cyc  = static_cast<double>(c[PerfCounters::cycles]);
+    double ins  = static_cast<double>(c[PerfCounters::instructions]);
+    double refs = static_cast<double>(c[PerfCounters::llc_references]);
+    double miss = static_cast<double>(c[PerfCounters::llc_misses]);
+    printf("%s  %13.6e  %13.6e  %6.3f  %12.4f  %13.6e  %11.4f\n",
+           padded_name_str.c_str(), cyc, ins, (cyc > 0) ? ins / cyc : 0.0,
+           (refs > 0) ? miss / refs : 0.0, miss,
+           (p.timeList[i] > 0)
+               ? miss * PerfCounters::cache_line_size / p.timeList[i] / 1e9
+               : 0.0);
+  }
+#endif
+}
+
+void TimerManagerClass::print_roofline()
+{
+#if ENABLE_TIMERS
+  FlatProfileData p;
+
+  collate_flat_profile(p);
+
+  int max_name_len = 5;
+  bool has_work    = false;
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+  {
+    if (p.flopList[it->second] <= 0.0 && p.byteList[it->second] <= 0.0) continue;
+    has_work     = true;
+    max_name_len = std::max(max_name_len, static_cast<int>(it->first.size()));
+  }
+  if (!has_work) return;
+
+  printf("\nRoofline profile\n");
+  if (peak_gflops > 0.0 && peak_gbs > 0.0)
+    printf("Peak: %.3f GFLOP/s, %.3f GB/s, ridge point: %.3f flop/byte\n",
+           peak_gflops, peak_gbs, peak_gflops / peak_gbs);
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-11s  %-11s  %-10s  %-10s  %-10s  %-11s  %-9s  %-7s\n",
+         timer_name.c_str(), "GFLOP", "GB", "Flop/byte", "GFLOP/s", "GB/s",
+         "%peak_flop", "%peak_bw", "Bound");
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+  {
+    int i        = it->second;
+    double flops = p.flopList[i];
+    double bytes = p.byteList[i];
+    double t     = p.timeList[i];
+    if (flops <= 0.0 && bytes <= 0.0) continue;
+    std::string padded_name_str;
+    pad_string(it->first, padded_name_str, max_name_len);
+    double intensity = (bytes > 0.0) ? flops / bytes : 0.0;
+    double gflops    = (t > 0.0) ? flops / t / 1e9 : 0.0;
+    double gbs       = (t > 0.0) ? bytes / t / 1e9 : 0.0;
+    printf("%s  %11.4e  %11.4e  %10.3f  %10.4f  %10.4f", padded_name_str.c_str(),
+           flops / 1e9, bytes / 1e9, intensity, gflops, gbs);
+    if (peak_gflops > 0.0 && peak_gbs > 0.0)
+      printf("  %11.2f  %9.2f  %-7s\n", 100.0 * gflops / peak_gflops,
+             100.0 * gbs / peak_gbs,
+             (intensity < peak_gflops / peak_gbs) ? "memory" : "compute");
+    else
+      printf("  %11s  %9s  %-7s\n", "-", "-", "-");
+  }
+#endif
+}
+
+void TimerManagerClass::collate_thread_profile(ThreadProfileData &p)
+{
+  int nthreads = CurrentTimerStack.size();
+  for (int i = 0; i < TimerList.size(); ++i)
+  {
+    NewTimer &timer = *TimerList[i];
+    nameList_t::iterator it(p.nameList.find(timer.get_name()));
+    int ind;
+    if (it == p.nameList.end())
+    {
+      ind                          = p.nameList.size();
+      p.nameList[timer.get_name()] = ind;
+      p.timeList.push_back(timeList_t(nthreads, 0.0));
+      p.callList.push_back(callList_t(nthreads, 0));
+    }
+    else
+    {
+      ind = (*it).second;
+    }
+    for (int tid = 0; tid < std::min(nthreads, timer.num_threads()); tid++)
+    {
+      p.timeList[ind][tid] += timer.get_thread_total(tid);
+      p.callList[ind][tid] += timer.get_thread_num_calls(tid);
+    }
+  }
+}
+
+void TimerManagerClass::print_threads()
+{
+#if ENABLE_TIMERS
+  ThreadProfileData p;
+
+  collate_thread_profile(p);
+
+  // only timers used by more than one thread are reported
+  int max_name_len = 5;
+  std::vector<int> nactive(p.timeList.size(), 0);
+  bool has_threads = false;
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+  {
+    int i = it->second;
+    for (int tid = 0; tid < p.callList[i].size(); tid++)
+      if (p.callList[i][tid] > 0) nactive[i]++;
+    if (nactive[i] < 2) continue;
+    has_threads  = true;
+    max_name_len = std::max(max_name_len, static_cast<int>(it->first.size()));
+  }
+  if (!has_threads) return;
+
+  // min/avg/max over the threads that called the timer, imbalance = max/avg-1
+  printf("\nThread profile\n");
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-7s  %-9s  %-9s  %-9s  %-9s\n", timer_name.c_str(), "Threads",
+         "Min_time", "Avg_time", "Max_time", "Imbalance");
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+  {
+    int i = it->second;
+    if (nactive[i] < 2) continue;
+    double tmin = std::numeric_limits<double>::max(), tmax = 0.0, tavg = 0.0;
+    for (int tid = 0; tid < p.timeList[i].size(); tid++)
+    {
+      if (p.callList[i][tid] == 0) continue;
+      tmin = std::min(tmin, p.timeList[i][tid]);
+      tmax = std::max(tmax, p.timeList[i][tid]);
+      tavg += p.timeList[i][tid];
+    }
+    tavg /= nactive[i];
+    std::string padded_name_str;
+    pad_string(it->first, padded_name_str, max_name_len);
+    printf("%s  %7d  %9.4f  %9.4f  %9.4f  %9.4f\n", padded_name_str.c_str(),
+           nactive[i], tmin, tavg, tmax, (tavg > 0.0) ? tmax / tavg - 1.0 : 0.0);
+  }
+#endif
+}
+
+void TimerManagerClass::collect_samples(bool record)
+{
+  FlatProfileData p;
+  collate_flat_profile(p);
+  for (nameList_t::iterator it = p.nameList.begin(); it != p.nameList.end(); ++it)
+  {
+    int i = it->second;
+    std::pair<double, long> &start = sample_start[it->first];
+    if (record && p.callList[i] > start.second)
+      timer_samples[it->first].push_back(p.timeList[i] - start.first);
+    start = std::make_pair(p.timeList[i], p.callList[i]);
+  }
+}
+
+bool TimerManagerClass::write_samples(const std::string &fname) const
+{
+  std::ofstream out(fname.c_str());
+  if (!out) return false;
+  out << "# timer samples: name, number of samples, samples (s), tab separated\n";
+  char buf[32];
+  std::map<std::string, std::vector<double>>::const_iterator it = timer_samples.begin();
+  for (; it != timer_samples.end(); ++it)
+  {
+    out << it->first << "\t" << it->second.size();
+    for (int n = 0; n < it->second.size(); n++)
+    {
+      snprintf(buf, sizeof(buf), "\t%.9e", it->second[n]);
+      out << buf;
+    }
+    out << "\n";
+  }
+  return bool(out);
+}
+
+static bool read_samples(const std::string &fname,
+                         std::map<std::string, std::vector<double>> &samples)
+{
+  std::ifstream in(fname.c_str());
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] == '#') continue;
+    std::string::size_type pos = line.find('\t');
+    if (pos == std::string::npos) return false;
+    std::istringstream values(line.substr(pos + 1));
+    int n = 0;
+    if (!(values >> n)) return false;
+    std::vector<double> &v = samples[line.substr(0, pos)];
+    v.resize(n);
+    for (int i = 0; i < n; i++)
+      if (!(values >> v[i])) return false;
+  }
+  return true;
+}
+
+static double median(std::vector<double> v)
+{
+  if (v.empty()) return 0.0;
+  std::sort(v.begin(), v.end());
+  int n = v.size();
+  return (n % 2 == 1) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// One-sided p-value of the Mann-Whitney U test of the hypothesis that b is not
+// stochastically larger than a, from the normal approximation with tie and
+// continuity corrections.
+static double mann_whitney_greater(const std::vector<double> &a,
+                                   const std::vector<double> &b)
+{
+  double na = a.size(), nb = b.size(), n = na + nb;
+  std::vector<std::pair<double, int>> all;
+  for (int i = 0; i < a.size(); i++)
+    all.push_back(std::make_pair(a[i], 0));
+  for (int i = 0; i < b.size(); i++)
+    all.push_back(std::make_pair(b[i], 1));
+  std::sort(all.begin(), all.end());
+  // sum of the ranks of b, tied values get the average of their ranks
+  double rank_b = 0.0, ties = 0.0;
+  for (int i = 0; i < all.size();)
+  {
+    int j = i;
+    while (j < all.size() && all[j].first == all[i].first)
+      j++;
+    double t    = j - i;
+    double rank = 0.5 * (i + 1 + j);
+    for (int k = i; k < j; k++)
+      if (all[k].second == 1) rank_b += rank;
+    ties += t * t * t - t;
+    i = j;
+  }
+  double u     = rank_b - nb * (nb + 1.0) / 2.0;
+  double sigma2 = na * nb / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+  if (sigma2 <= 0.0) return 1.0;
+  double z = (u - na * nb / 2.0 - 0.5) / std::sqrt(sigma2);
+  return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+int TimerManagerClass::compare_samples(const std::string &fname,
+                                       double threshold, double alpha)
+{
+  std::map<std::string, std::vector<double>> baseline;
+  if (!read_samples(fname, baseline)) return -1;
+
+  int max_name_len = 5;
+  std::map<std::string, std::vector<double>>::iterator it = baseline.begin();
+  for (; it != baseline.end(); ++it)
+    max_name_len = std::max(max_name_len, static_cast<int>(it->first.size()));
+
+  printf("\nComparison with baseline %s (threshold %.1f%%, significance %.3g)\n",
+         fname.c_str(), 100.0 * threshold, alpha);
+  std::string timer_name;
+  pad_string("Timer", timer_name, max_name_len);
+  printf("%s  %-7s  %-11s  %-11s  %-9s  %-9s  %s\n", timer_name.c_str(),
+         "Samples", "Base_median", "Median", "Change(%)", "p-value", "Status");
+  int nregressions = 0;
+  for (it = baseline.begin(); it != baseline.end(); ++it)
+  {
+    std::string padded_name_str;
+    pad_string(it->first, padded_name_str, max_name_len);
+    std::map<std::string, std::vector<double>>::iterator cur =
+        timer_samples.find(it->first);
+    if (cur == timer_samples.end())
+    {
+      printf("%s  %7d  %11.4e  %11s  %9s  %9s  %s\n", padded_name_str.c_str(),
+             0, median(it->second), "-", "-", "-", "missing");
+      continue;
+    }
+    const std::vector<double> &a = it->second;
+    const std::vector<double> &b = cur->second;
+    double ma = median(a), mb = median(b);
+    double change = (ma > 0.0) ? mb / ma - 1.0 : 0.0;
+    // at least 2 samples of each are needed for the test
+    if (a.size() < 2 || b.size() < 2)
+    {
+      printf("%s  %7d  %11.4e  %11.4e  %9.2f  %9s  %s\n", padded_name_str.c_str(),
+             static_cast<int>(b.size()), ma, mb, 100.0 * change, "-", "untested");
+      continue;
+    }
+    double pvalue   = mann_whitney_greater(a, b);
+    bool regression = change > threshold && pvalue < alpha;
+    if (regression) nregressions++;
+    printf("%s  %7d  %11.4e  %11.4e  %9.2f  %9.3g  %s\n", padded_name_str.c_str(),
+           static_cast<int>(b.size()), ma, mb, 100.0 * change, pvalue,
+           regression ? "REGRESSION" : "ok");
+  }
+  return nregressions;
+}
+
 // Might want some sort of structured output for timing data - either xml or
 // yaml
 #if 0
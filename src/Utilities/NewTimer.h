@@ -111,11 +111,60 @@
  * The 'coarse' level is the default.
  * Typically a command line option will be used to adjust this level.
  *
+ * ### Hardware counters
+ *
+ * A call to TimerManager.enable_hardware_counters() opens the hardware
+ * performance counters (see PerfCounters.h). Active timers then accumulate
+ * the counts of the timed sections, and print() adds a table with the
+ * instructions per cycle and the LLC miss rate of every timer.
+ *
+ * ### Roofline
+ *
+ * The floating point operations and the bytes of memory traffic of a timed
+ * section can be registered with
+ * @code
+ * timer1->add_work(flops, bytes);
+ * @endcode
+ * print() then adds a table with the achieved GFLOP/s and GB/s of every timer
+ * with registered work, and their fraction of the peaks given to
+ * TimerManager.set_machine_peak.
+ *
+ * ### Threads
+ *
+ * Timers can be started and stopped inside OpenMP parallel regions. Every
+ * thread has its own timer stack and accumulates its own time and calls.
+ * The stacks of threads other than 0 start inside the parallel region, so
+ * their timers appear at the top level of the stack profile.
+ * The profiles report, for every timer, the maximum over the threads, and
+ * print() adds a table with the min/avg/max time across the threads and the
+ * imbalance, max/avg-1, of the timers used by more than one thread.
+ * Hardware counters are read by thread 0 only. Nested parallel regions are
+ * not supported.
+ *
+ * ### Event trace
+ *
+ * TimerManager.enable_trace(capacity) records the begin and end events of the
+ * active timers, with the current step and substep (set_trace_step), into a
+ * ring buffer per thread that keeps the last capacity events.
+ * TimerManager.write_trace(filename) writes them in the Chrome trace-event
+ * JSON format, which can be opened with chrome://tracing or Perfetto.
+ *
+ * ### Regression baselines
+ *
+ * Every call to TimerManager.collect_samples() records, for every timer
+ * called since the previous call, the time spent in between as one sample.
+ * write_samples(filename) stores the samples of all timers as a baseline and
+ * compare_samples(filename, threshold) compares the current samples with a
+ * stored baseline. A timer is a regression when its median is more than
+ * threshold (relative) slower than in the baseline and the one-sided
+ * Mann-Whitney U test rejects, at significance alpha, that it is not slower.
+ *
  */
 #ifndef QMCPLUSPLUS_NEW_TIMER_H
 #define QMCPLUSPLUS_NEW_TIMER_H
 
 #include <Utilities/Clock.h>
+#include <Utilities/PerfCounters.h>
 //#include <OhmmsData/Libxml2Doc.h>
 #include <vector>
 #include <string>
@@ -225,16 +274,43 @@ public:
 // N = 2 gives 16 nesting levels
 typedef StackKeyParam<2> StackKey;
 
+// begin ('B') or end ('E') event of a timer, recorded in the event trace
+struct TimerTraceEvent
+{
+  double time;
+  int step;
+  int substep;
+  timer_id_t id;
+  char phase;
+};
+
 class TimerManagerClass
 {
 protected:
   std::vector<NewTimer *> TimerList;
-  std::vector<NewTimer *> CurrentTimerStack;
+  // one stack per thread
+  std::vector<std::vector<NewTimer *>> CurrentTimerStack;
   timer_levels timer_threshold;
   timer_id_t max_timer_id;
   bool max_timers_exceeded;
   std::map<timer_id_t, std::string> timer_id_name;
   std::map<std::string, timer_id_t> timer_name_to_id;
+  PerfCounters counters;
+  bool counters_enabled;
+  double peak_gflops;
+  double peak_gbs;
+  // event trace: one ring buffer per thread and the number of events recorded
+  bool trace_enabled;
+  std::vector<std::vector<TimerTraceEvent>> trace_buffer;
+  std::vector<long> trace_count;
+  double trace_start;
+  int trace_rank;
+  int trace_step;
+  int trace_substep;
+  // samples of the time of every timer between calls to collect_samples,
+  // and the time and calls of the timers at the last call
+  std::map<std::string, std::vector<double>> timer_samples;
+  std::map<std::string, std::pair<double, long>> sample_start;
 
 public:
 #ifdef USE_VTUNE_TASKS
@@ -243,8 +319,11 @@ public:
 
   TimerManagerClass()
       : timer_threshold(timer_level_coarse), max_timer_id(1),
-        max_timers_exceeded(false)
+        max_timers_exceeded(false), counters_enabled(false),
+        peak_gflops(0.0), peak_gbs(0.0), trace_enabled(false),
+        trace_start(0.0), trace_rank(0), trace_step(-1), trace_substep(-1)
   {
+    CurrentTimerStack.resize(omp_get_max_threads());
 #ifdef USE_VTUNE_TASKS
     task_domain = __itt_domain_create("QMCPACK");
 #endif
@@ -253,26 +332,28 @@ public:
   NewTimer *createTimer(const std::string &myname,
                         timer_levels mytimer = timer_level_fine);
 
-  void push_timer(NewTimer *t)
+  int num_thread_stacks() const { return CurrentTimerStack.size(); }
+
+  void push_timer(NewTimer *t, int tid = 0)
   {
     {
-      CurrentTimerStack.push_back(t);
+      CurrentTimerStack[tid].push_back(t);
     }
   }
 
-  void pop_timer()
+  void pop_timer(int tid = 0)
   {
     {
-      CurrentTimerStack.pop_back();
+      CurrentTimerStack[tid].pop_back();
     }
   }
 
-  NewTimer *current_timer()
+  NewTimer *current_timer(int tid = 0)
   {
     NewTimer *current = NULL;
-    if (CurrentTimerStack.size() > 0)
+    if (CurrentTimerStack[tid].size() > 0)
     {
-      current = CurrentTimerStack.back();
+      current = CurrentTimerStack[tid].back();
     }
     return current;
   }
@@ -281,10 +362,68 @@ public:
 
   bool maximum_number_of_timers_exceeded() const { return max_timers_exceeded; }
 
+  /// opens the hardware counters, returns the number of available counters
+  int enable_hardware_counters();
+  void disable_hardware_counters();
+  bool hardware_counters_enabled() const { return counters_enabled; }
+  const PerfCounters &get_hardware_counters() const { return counters; }
+
+  void read_hardware_counters(PerfCounters::values_t &val) const
+  {
+    counters.read(val);
+  }
+
+  /// peak floating point throughput (GFLOP/s) and memory bandwidth (GB/s)
+  void set_machine_peak(double gflops, double gbs)
+  {
+    peak_gflops = gflops;
+    peak_gbs    = gbs;
+  }
+
+  /// starts recording events, keeping the last capacity events of every thread
+  void enable_trace(long capacity, int rank = 0);
+  void disable_trace() { trace_enabled = false; }
+  bool trace_is_enabled() const { return trace_enabled; }
+
+  /// step and substep attached to the following events
+  void set_trace_step(int step, int substep)
+  {
+    trace_step    = step;
+    trace_substep = substep;
+  }
+
+  void trace_event(timer_id_t id, char phase, int tid, double time)
+  {
+    if (tid >= trace_buffer.size()) return;
+    std::vector<TimerTraceEvent> &buf = trace_buffer[tid];
+    TimerTraceEvent &e = buf[trace_count[tid] % buf.size()];
+    e.time             = time;
+    e.step             = trace_step;
+    e.substep          = trace_substep;
+    e.id               = id;
+    e.phase            = phase;
+    trace_count[tid]++;
+  }
+
+  /// writes the recorded events in Chrome trace-event format, returns false on errors
+  bool write_trace(const std::string &fname);
+
+  /// records the time of every timer called since the last call as a sample, if record is true
+  void collect_samples(bool record = true);
+  void clear_samples() { timer_samples.clear(); }
+  /// writes the samples as a baseline for compare_samples, returns false on errors
+  bool write_samples(const std::string &fname) const;
+  /// prints the comparison with the baseline in fname, returns the number of regressions, -1 on errors
+  int compare_samples(const std::string &fname, double threshold,
+                      double alpha = 0.01);
+
   void reset();
   void print();
   void print_flat();
   void print_stack();
+  void print_counters();
+  void print_roofline();
+  void print_threads();
 
   typedef std::map<std::string, int> nameList_t;
   typedef std::vector<double> timeList_t;
@@ -296,6 +435,9 @@ public:
     nameList_t nameList;
     timeList_t timeList;
     callList_t callList;
+    std::vector<PerfCounters::values_t> counterList;
+    timeList_t flopList;
+    timeList_t byteList;
   };
 
   struct StackProfileData
@@ -311,6 +453,15 @@ public:
 
   void collate_stack_profile(StackProfileData &p);
 
+  struct ThreadProfileData
+  {
+    nameList_t nameList;
+    std::vector<timeList_t> timeList; // [timer][thread]
+    std::vector<callList_t> callList; // [timer][thread]
+  };
+
+  void collate_thread_profile(ThreadProfileData &p);
+
   // void output_timing(Communicate *comm, Libxml2Document &doc, xmlNodePtr
   // root);
 
@@ -323,21 +474,44 @@ extern TimerManagerClass TimerManager;
 class NewTimer
 {
 protected:
-  double start_time;
-  double total_time;
-  long num_calls;
+  // time and calls accumulated by one thread
+  struct ThreadData
+  {
+    double start_time;
+    double total_time;
+    long num_calls;
+    double total_flops;
+    double total_bytes;
+#ifdef USE_STACK_TIMERS
+    NewTimer *parent;
+    StackKey current_stack_key;
+
+    std::map<StackKey, double> per_stack_total_time;
+    std::map<StackKey, long> per_stack_num_calls;
+#endif
+
+    ThreadData()
+        : start_time(0.0), total_time(0.0), num_calls(0), total_flops(0.0),
+          total_bytes(0.0)
+#ifdef USE_STACK_TIMERS
+          ,
+          parent(NULL)
+#endif
+    {
+    }
+  };
+
+  std::vector<ThreadData> thread_data;
   std::string name;
   bool active;
   timer_levels timer_level;
   timer_id_t timer_id;
 #ifdef USE_STACK_TIMERS
   TimerManagerClass *manager;
-  NewTimer *parent;
-  StackKey current_stack_key;
-
-  std::map<StackKey, double> per_stack_total_time;
-  std::map<StackKey, long> per_stack_num_calls;
 #endif
+  // read by thread 0 only
+  PerfCounters::values_t start_counts;
+  PerfCounters::values_t total_counts;
 
 #ifdef USE_VTUNE_TASKS
   __itt_string_handle *task_name;
@@ -359,35 +533,40 @@ public:
                        task_name);
 #endif
 
+      const int tid = omp_get_thread_num();
+      if (tid >= thread_data.size()) return;
+      ThreadData &td = thread_data[tid];
 #ifdef USE_STACK_TIMERS
-#pragma omp master
+      if (manager)
       {
-        if (manager)
+        NewTimer *current = manager->current_timer(tid);
+        if (this == current)
         {
-          if (this == manager->current_timer())
-          {
-            std::cerr << "Timer loop: " << name << std::endl;
-          }
-          if (parent != manager->current_timer())
-          {
-            parent = manager->current_timer();
-            if (parent)
-            {
-              current_stack_key = parent->get_stack_key();
-              current_stack_key.add_id(timer_id);
-            }
-          }
-          if (parent == NULL)
+          std::cerr << "Timer loop: " << name << std::endl;
+        }
+        if (td.parent != current)
+        {
+          td.parent = current;
+          if (td.parent)
           {
-            current_stack_key = StackKey();
-            current_stack_key.add_id(timer_id);
+            td.current_stack_key = td.parent->get_stack_key(tid);
+            td.current_stack_key.add_id(timer_id);
           }
-          manager->push_timer(this);
         }
-        start_time = cpu_clock();
+        if (td.parent == NULL)
+        {
+          td.current_stack_key = StackKey();
+          td.current_stack_key.add_id(timer_id);
+        }
+        manager->push_timer(this, tid);
+        if (tid == 0 && manager->hardware_counters_enabled())
+          manager->read_hardware_counters(start_counts);
       }
-#else
-      start_time = cpu_clock();
+#endif
+      td.start_time = cpu_clock();
+#ifdef USE_STACK_TIMERS
+      if (manager && manager->trace_is_enabled())
+        manager->trace_event(timer_id, 'B', tid, td.start_time);
 #endif
     }
   }
@@ -401,22 +580,32 @@ public:
       __itt_task_end(manager->task_domain);
 #endif
 
-#ifdef USE_STACK_TIMERS
-#pragma omp master
-#endif
+      const int tid = omp_get_thread_num();
+      if (tid >= thread_data.size()) return;
+      ThreadData &td = thread_data[tid];
       {
-        double elapsed = cpu_clock() - start_time;
-        total_time += elapsed;
-        num_calls++;
+        double stop_time = cpu_clock();
+        double elapsed   = stop_time - td.start_time;
+        td.total_time += elapsed;
+        td.num_calls++;
 
 #ifdef USE_STACK_TIMERS
-        per_stack_total_time[current_stack_key] += elapsed;
-        per_stack_num_calls[current_stack_key] += 1;
+        if (manager && manager->trace_is_enabled())
+          manager->trace_event(timer_id, 'E', tid, stop_time);
+        if (tid == 0 && manager && manager->hardware_counters_enabled())
+        {
+          PerfCounters::values_t stop_counts;
+          manager->read_hardware_counters(stop_counts);
+          for (int i = 0; i < PerfCounters::num_counters; i++)
+            total_counts[i] += stop_counts[i] - start_counts[i];
+        }
+        td.per_stack_total_time[td.current_stack_key] += elapsed;
+        td.per_stack_num_calls[td.current_stack_key] += 1;
 
         if (manager)
         {
-          manager->current_timer()->set_parent(NULL);
-          manager->pop_timer();
+          manager->current_timer(tid)->set_parent(NULL, tid);
+          manager->pop_timer(tid);
         }
 #endif
       }
@@ -424,30 +613,109 @@ public:
   }
 #endif
 
+  /// number of threads with their own accumulators
+  int num_threads() const { return thread_data.size(); }
+
 #ifdef USE_STACK_TIMERS
-  std::map<StackKey, double> &get_per_stack_total_time()
+  std::map<StackKey, double> &get_per_stack_total_time(int tid = 0)
   {
-    return per_stack_total_time;
+    return thread_data[tid].per_stack_total_time;
   }
 
-  StackKey &get_stack_key() { return current_stack_key; }
+  StackKey &get_stack_key(int tid = 0)
+  {
+    return thread_data[tid].current_stack_key;
+  }
 #endif
 
-  inline double get_total() const { return total_time; }
+  /// time of thread tid
+  inline double get_thread_total(int tid) const
+  {
+    return thread_data[tid].total_time;
+  }
+
+  /// calls of thread tid
+  inline long get_thread_num_calls(int tid) const
+  {
+    return thread_data[tid].num_calls;
+  }
+
+  /// maximum time over the threads
+  inline double get_total() const
+  {
+    double t = 0.0;
+    for (int i = 0; i < thread_data.size(); i++)
+      t = std::max(t, thread_data[i].total_time);
+    return t;
+  }
 
 #ifdef USE_STACK_TIMERS
   inline double get_total(const StackKey &key)
   {
-    return per_stack_total_time[key];
+    double t = 0.0;
+    for (int i = 0; i < thread_data.size(); i++)
+    {
+      std::map<StackKey, double>::const_iterator it =
+          thread_data[i].per_stack_total_time.find(key);
+      if (it != thread_data[i].per_stack_total_time.end())
+        t = std::max(t, it->second);
+    }
+    return t;
   }
 #endif
 
-  inline long get_num_calls() const { return num_calls; }
+  /// maximum number of calls over the threads
+  inline long get_num_calls() const
+  {
+    long n = 0;
+    for (int i = 0; i < thread_data.size(); i++)
+      n = std::max(n, thread_data[i].num_calls);
+    return n;
+  }
+
+  inline const PerfCounters::values_t &get_counters() const
+  {
+    return total_counts;
+  }
+
+  /// registers floating point operations and bytes of memory traffic of the timed section
+  inline void add_work(double flops, double bytes)
+  {
+    const int tid = omp_get_thread_num();
+    if (tid >= thread_data.size()) return;
+    thread_data[tid].total_flops += flops;
+    thread_data[tid].total_bytes += bytes;
+  }
+
+  /// work registered by all the threads
+  inline double get_flops() const
+  {
+    double f = 0.0;
+    for (int i = 0; i < thread_data.size(); i++)
+      f += thread_data[i].total_flops;
+    return f;
+  }
+
+  inline double get_bytes() const
+  {
+    double b = 0.0;
+    for (int i = 0; i < thread_data.size(); i++)
+      b += thread_data[i].total_bytes;
+    return b;
+  }
 
 #ifdef USE_STACK_TIMERS
   inline long get_num_calls(const StackKey &key)
   {
-    return per_stack_num_calls[key];
+    long n = 0;
+    for (int i = 0; i < thread_data.size(); i++)
+    {
+      std::map<StackKey, long>::const_iterator it =
+          thread_data[i].per_stack_num_calls.find(key);
+      if (it != thread_data[i].per_stack_num_calls.end())
+        n = std::max(n, it->second);
+    }
+    return n;
   }
 #endif
 
@@ -459,16 +727,22 @@ public:
 
   inline void reset()
   {
-    num_calls  = 0;
-    total_time = 0.0;
+    for (int i = 0; i < thread_data.size(); i++)
+    {
+      thread_data[i].num_calls   = 0;
+      thread_data[i].total_time  = 0.0;
+      thread_data[i].total_flops = 0.0;
+      thread_data[i].total_bytes = 0.0;
+    }
+    total_counts.clear();
   }
 
   NewTimer(const std::string &myname, timer_levels mytimer = timer_level_fine)
-      : total_time(0.0), num_calls(0), name(myname), active(true),
+      : thread_data(omp_get_max_threads()), name(myname), active(true),
         timer_level(mytimer), timer_id(0)
 #ifdef USE_STACK_TIMERS
         ,
-        manager(NULL), parent(NULL)
+        manager(NULL)
 #endif
   {
 #ifdef USE_VTUNE_TASKS
@@ -490,9 +764,12 @@ public:
   }
 
 #ifdef USE_STACK_TIMERS
-  NewTimer *get_parent() { return parent; }
+  NewTimer *get_parent(int tid = 0) { return thread_data[tid].parent; }
 
-  void set_parent(NewTimer *new_parent) { parent = new_parent; }
+  void set_parent(NewTimer *new_parent, int tid = 0)
+  {
+    thread_data[tid].parent = new_parent;
+  }
 #endif
 };
 
@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file PerfCounters.cpp
+ * @brief Implements PerfCounters
+ */
+#include "Utilities/PerfCounters.h"
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace qmcplusplus
+{
+PerfCounters::PerfCounters() : opened(false)
+{
+  for (int i = 0; i < num_counters; i++)
+    fd[i] = -1;
+}
+
+PerfCounters::~PerfCounters() { close(); }
+
+const char *PerfCounters::name(int i)
+{
+  static const char *names[] = {"cycles", "instructions", "LLC_references",
+                                "LLC_misses"};
+  return (i >= 0 && i < num_counters) ? names[i] : "unknown";
+}
+
+int PerfCounters::open()
+{
+  close();
+  opened = true;
+  int navail = 0;
+#if defined(__linux__) && defined(__NR_perf_event_open)
+  const unsigned long long config[] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+  for (int i = 0; i < num_counters; i++)
+  {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.inherit        = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd[i] >= 0) navail++;
+  }
+#endif
+  return navail;
+}
+
+void PerfCounters::close()
+{
+#if defined(__linux__)
+  for (int i = 0; i < num_counters; i++)
+    if (fd[i] >= 0) ::close(fd[i]);
+#endif
+  for (int i = 0; i < num_counters; i++)
+    fd[i] = -1;
+  opened = false;
+}
+
+bool PerfCounters::any_available() const
+{
+  for (int i = 0; i < num_counters; i++)
+    if (fd[i] >= 0) return true;
+  return false;
+}
+
+void PerfCounters::read(values_t &val) const
+{
+  for (int i = 0; i < num_counters; i++)
+  {
+    val[i] = 0;
+#if defined(__linux__)
+    if (fd[i] < 0) continue;
+    // value, time enabled, time running
+    unsigned long long buf[3] = {0, 0, 0};
+    if (::read(fd[i], buf, sizeof(buf)) != sizeof(buf)) continue;
+    if (buf[2] > 0 && buf[2] < buf[1])
+      val[i] = static_cast<long long>(double(buf[0]) * double(buf[1]) /
+                                      double(buf[2]));
+    else
+      val[i] = static_cast<long long>(buf[0]);
+#endif
+  }
+}
+}
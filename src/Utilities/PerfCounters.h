@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+
+/** @file PerfCounters.h
+ * @brief Hardware performance counters read through perf_event_open.
+ *
+ * The counters count the calling process in user mode, including the threads
+ * created after the counters are opened. Counters that can not be opened
+ * (no PMU, restrictive perf_event_paranoid, non-linux systems) are marked as
+ * unavailable and read as zero.
+ *
+ * @code
+ * PerfCounters pc;
+ * pc.open();
+ * PerfCounters::values_t v0, v1;
+ * pc.read(v0);
+ * // Code to be measured
+ * pc.read(v1);
+ * long long cycles = v1[PerfCounters::cycles] - v0[PerfCounters::cycles];
+ * @endcode
+ */
+#ifndef QMCPLUSPLUS_PERF_COUNTERS_H
+#define QMCPLUSPLUS_PERF_COUNTERS_H
+
+namespace qmcplusplus
+{
+
+class PerfCounters
+{
+public:
+  enum counter_id
+  {
+    cycles,
+    instructions,
+    llc_references,
+    llc_misses,
+    num_counters
+  };
+
+  // size of the cache line used to estimate the memory traffic from the LLC misses
+  static const int cache_line_size = 64;
+
+  struct values_t
+  {
+    long long v[num_counters];
+
+    values_t() { clear(); }
+    void clear()
+    {
+      for (int i = 0; i < num_counters; i++)
+        v[i] = 0;
+    }
+    long long &operator[](int i) { return v[i]; }
+    long long operator[](int i) const { return v[i]; }
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+
+  /// opens the counters, returns the number of available counters
+  int open();
+  void close();
+
+  /// reads the current value of the counters, scaled for multiplexing
+  void read(values_t &val) const;
+
+  bool is_open() const { return opened; }
+  bool available(int i) const { return fd[i] >= 0; }
+  bool any_available() const;
+
+  static const char *name(int i);
+
+private:
+  int fd[num_counters];
+  bool opened;
+};
+}
+
+#endif
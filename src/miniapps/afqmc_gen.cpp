@@ -0,0 +1,117 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+// -*- C++ -*-
+/** @file afqmc_gen.cpp
+    @brief Generator of synthetic input files for the miniapp
+
+    Writes a synthetic Hamiltonian (see Matrix/synthetic_hamiltonian.hpp) with the
+    hdf5 layout read by miniafqmc.
+ */
+#include <Configuration.h>
+#include <getopt.h>
+#include "io/hdf_archive.h"
+
+#include "Matrix/synthetic_hamiltonian.hpp"
+
+using namespace std;
+using namespace qmcplusplus;
+
+void print_help()
+{
+  printf("afqmc_gen - synthetic Hamiltonian generator for the AFQMC miniapp\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("-n                Number of molecular orbitals (required)\n");
+  printf("-e                Number of electrons of each spin (required)\n");
+  printf("-c                Number of Cholesky vectors (required by the random model)\n");
+  printf("-s                Probability of a non-zero off-diagonal element in a Cholesky vector (default: 0.2)\n");
+  printf("-b                Cholesky vectors only couple orbitals within blocks of this size, 0 for no blocks (default: 0)\n");
+  printf("-m                Model: random or hubbard (default: random)\n");
+  printf("-r                Seed of the random number generator (default: 7)\n");
+  printf("-o                Output file name (default: ./afqmc.h5)\n");
+}
+
+int main(int argc, char **argv)
+{
+
+#ifndef QMC_COMPLEX
+  std::cerr<<" Error: Please compile complex executable, QMC_COMPLEX=1. " <<std::endl;
+  exit(1);
+#endif
+
+  // 1-body propagators are assumed by the miniapp to be generated with a timestep = 0.01
+  const double dt = 0.01;
+  std::string out_file = "afqmc.h5";
+  afqmc::SyntheticParameters params;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hn:e:c:s:b:m:r:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h': print_help(); return 1;
+    case 'n':
+      params.NMO = atoi(optarg);
+      break;
+    case 'e':
+      params.NAEA = atoi(optarg);
+      break;
+    case 'c':
+      params.nchol = atoi(optarg);
+      break;
+    case 's':
+      params.sparsity = atof(optarg);
+      break;
+    case 'b':
+      params.block = atoi(optarg);
+      break;
+    case 'm':
+      params.model = std::string(optarg);
+      break;
+    case 'r':
+      params.seed = static_cast<unsigned>(atol(optarg));
+      break;
+    case 'o':
+      out_file = std::string(optarg);
+      break;
+    }
+  }
+
+  if(!params.valid()) {
+    print_help();
+    return 1;
+  }
+
+  afqmc::SyntheticHamiltonian H;
+  afqmc::generate_hamiltonian(params,dt,H);
+
+  hdf_archive dump;
+  if(!dump.create(out_file))
+    APP_ABORT("Error: problems creating hdf5 file. \n");
+  if(!afqmc::write_hamiltonian(dump,H)) {
+    std::cerr<<" Error writing synthetic Hamiltonian to hdf5 file: " <<out_file <<std::endl;
+    exit(1);
+  }
+  dump.close();
+
+  std::cout<<"  model: " <<params.model <<"\n"
+           <<"  NMO, NAEA, nchol: " <<H.NMO <<", " <<H.NAEA <<", " <<H.nchol <<"\n"
+           <<"  sparsity, block: " <<params.sparsity <<", " <<params.block <<"\n"
+           <<"  non-zeros in Spvn: " <<H.Spvn_vals.size() <<"\n"
+           <<"  non-zeros in Vakbl: " <<H.Vakbl_vals.size() <<"\n"
+           <<"  written to: " <<out_file <<"\n";
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+// -*- C++ -*-
+/** @file afqmc_replay.cpp
+    @brief Replays the stages of a substep recorded by the miniapp
+
+    Reads a substep recorded with miniafqmc -S, rebuilds the Hamiltonian from the input
+    file or synthetic Hamiltonian of the run, and re-runs every selected stage nrep times
+    on the recorded inputs. Reports the timings and the largest relative difference between
+    the result of the stage and the recorded result.
+
+    New kernel variants are compared by adding a stage to the list in main,
+    with the recorded inputs and the recorded result of the stage they replace.
+ */
+#include <Configuration.h>
+#include <getopt.h>
+
+#include "AFQMC/afqmc_sys.hpp"
+#include "AFQMC/rotate.hpp"
+#include "AFQMC/vHS.hpp"
+#include "AFQMC/vbias.hpp"
+#include "AFQMC/kernel_selection.hpp"
+#include "AFQMC/kernel_timing.hpp"
+#include "AFQMC/substep_record.hpp"
+#include "Matrix/initialize_serial.hpp"
+#include "Matrix/synthetic_hamiltonian.hpp"
+#include "Numerics/ma_operations.hpp"
+
+using namespace std;
+using namespace qmcplusplus;
+
+void print_help()
+{
+  printf("afqmc_replay - replays the stages of a substep recorded with miniafqmc -S\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("-f                Recorded substep (default: ./afqmc_substep.h5)\n");
+  printf("-i                Input file of the Hamiltonian (default: the input file of the recorded run)\n");
+  printf("-g                Synthetic Hamiltonian (default: the synthetic Hamiltonian of the recorded run)\n");
+  printf("-k                Comma separated list of stages (default: all)\n");
+  printf("-r                Number of repetitions of each stage (default: 1000)\n");
+  printf("-m                Storage format of the Cholesky matrices: csr, bsr, sell, dcsr, dense (default: csr)\n");
+  printf("-b                Block size of bsr format, slice height of sell format (default: 4)\n");
+  printf("-t                Largest relative difference with the recorded results (default: 1e-6)\n");
+  printf("\n");
+  printf("Stages: density_matrix, vbias, vHS, propagate, overlap\n");
+}
+
+// largest difference between A and the reference B, relative to the largest element of B
+template<class MatA, class MatB>
+double relative_difference(const MatA& A, const MatB& B)
+{
+  double diff = 0.0, norm = 0.0;
+  auto a = A.data();
+  auto b = B.data();
+  for(std::size_t i=0, n=B.num_elements(); i<n; i++) {
+    diff = std::max(diff,std::abs(a[i]-b[i]));
+    norm = std::max(norm,std::abs(b[i]));
+  }
+  return (norm > 0.0)?diff/norm:diff;
+}
+
+int main(int argc, char **argv)
+{
+
+#ifndef QMC_COMPLEX
+  std::cerr<<" Error: Please compile complex executable, QMC_COMPLEX=1. " <<std::endl;
+  exit(1);
+#endif
+
+  std::string record_file = "afqmc_substep.h5";
+  std::string init_file = "";
+  std::string synthetic_spec = "";
+  std::string stage_list = "";
+  std::string sp_format = "csr";
+  int bsr_block = 4;
+  int nrep = 1000;
+  double tolerance = 1e-6;
+  const int sell_sigma = 32;
+  const double dt = 0.01;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hf:i:g:k:r:m:b:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h': print_help(); return 1;
+    case 'f':
+      record_file = std::string(optarg);
+      break;
+    case 'i':
+      init_file = std::string(optarg);
+      break;
+    case 'g':
+      synthetic_spec = std::string(optarg);
+      break;
+    case 'k':
+      stage_list = std::string(optarg);
+      break;
+    case 'r':
+      nrep = atoi(optarg);
+      break;
+    case 'm':
+      sp_format = std::string(optarg);
+      break;
+    case 'b':
+      bsr_block = atoi(optarg);
+      break;
+    case 't':
+      tolerance = atof(optarg);
+      break;
+    }
+  }
+  if(nrep < 1) nrep = 1;
+
+  afqmc::SubstepRecord R;
+  if(!R.read(record_file)) {
+    std::cerr<<" Error reading recorded substep: " <<record_file <<std::endl;
+    exit(1);
+  }
+  if(init_file == "" && synthetic_spec == "") {
+    init_file = R.init_file;
+    synthetic_spec = R.synthetic_spec;
+  }
+
+  base::afqmc_sys AFQMCSys;
+  ComplexSpMat Spvn, SpvnT, Vakbl;
+  ComplexMatrix haj, Propg1;
+  if(synthetic_spec != "") {
+    afqmc::SyntheticParameters params;
+    if(!params.parse(synthetic_spec))
+      APP_ABORT(" Error: Invalid synthetic Hamiltonian. \n");
+    afqmc::SyntheticHamiltonian H;
+    afqmc::generate_hamiltonian(params,dt,H);
+    if(!afqmc::Initialize(H,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+      std::cerr<<" Error initalizing data structures from synthetic Hamiltonian: " <<synthetic_spec <<std::endl;
+      exit(1);
+    }
+  } else {
+    hdf_archive dump;
+    if(!dump.open(init_file,H5F_ACC_RDONLY))
+      APP_ABORT("Error: problems opening hdf5 file. \n");
+    if(!afqmc::Initialize(dump,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+      std::cerr<<" Error initalizing data structures from hdf5 file: " <<init_file <<std::endl;
+      exit(1);
+    }
+  }
+
+  const int NMO = R.NMO;
+  const int NAEA = R.NAEA;
+  const int nspin = R.nspin;
+  const int nwalk = R.nwalk;
+  if(AFQMCSys.NMO != NMO || AFQMCSys.NAEA != NAEA || Spvn.cols() != R.nchol) {
+    std::cerr<<" Error: The Hamiltonian does not match the recorded substep. " <<std::endl;
+    exit(1);
+  }
+  bool closed_shell = (nspin == 1);
+  if(R.transposed_Spvn)
+    base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,AFQMCSys.trialwfn_beta,Spvn,SpvnT,1e-6,closed_shell);
+
+  typedef afqmc::MatrixStorage<ComplexType,SpPtrType> ComplexMatStorage;
+  ComplexMatStorage stSpvn, stSpvnT;
+  stSpvn.set_format(Spvn,sp_format,bsr_block,sell_sigma);
+  if(R.transposed_Spvn)
+    stSpvnT.set_format(SpvnT,sp_format,bsr_block,sell_sigma);
+  const ComplexMatOp& opSpvn = stSpvn.op();
+  const ComplexMatOp& opSpvnT = stSpvnT.op();
+
+  // the propagators are stored as in the recorded run, sparse ones with the elements below the cutoff dropped
+  ComplexMatrix Propg2(extents[R.merged_propg?NMO:0][R.merged_propg?NMO:0]);
+  if(R.merged_propg) ma::product(Propg1,Propg1,Propg2);
+  ComplexSpMat Propg1_sp, Propg2_sp;
+  double err_fro;
+  if(R.sparse_propg1) afqmc::threshold_to_sparse(Propg1,R.propg_cutoff,Propg1_sp,err_fro);
+  if(R.sparse_propg2) afqmc::threshold_to_sparse(Propg2,R.propg_cutoff,Propg2_sp,err_fro);
+  ComplexMatOp opPropg1 = R.sparse_propg1?ComplexMatOp(Propg1_sp):ComplexMatOp(Propg1);
+  ComplexMatOp opPropg2 = R.sparse_propg2?ComplexMatOp(Propg2_sp):ComplexMatOp(Propg2);
+
+  std::cout<<"  Recorded substep: step " <<R.step <<", substep " <<R.substep <<"\n"
+           <<"  NMO, NAEA, nspin, nchol, nwalk: " <<NMO <<", " <<NAEA <<", " <<nspin <<", "
+           <<R.nchol <<", " <<nwalk <<"\n"
+           <<"  transposed Spvn: " <<std::boolalpha <<R.transposed_Spvn
+           <<", vHS layout: " <<(R.walker_major_vHS?"walker":"orbital")
+           <<", one-body half-steps: " <<(R.merged_propg?"merged":"split") <<"\n"
+           <<"  storage format: " <<sp_format <<"\n"
+           <<"  propagator storage: " <<(R.merged_propg?opPropg2:opPropg1).format();
+  if(R.merged_propg?R.sparse_propg2:R.sparse_propg1)
+    std::cout<<", cutoff: " <<R.propg_cutoff;
+  std::cout<<"\n\n";
+
+  // work space of the stages
+  WalkerContainer W(extents[nwalk][nspin][NMO][NAEA]);
+  ComplexMatrix W_data(R.W_data);
+  ComplexMatrix G(extents[R.G.shape()[0]][nwalk]);
+  ComplexMatrix vbias(extents[R.nchol][nwalk]);
+  ComplexMatrix vHS(extents[R.vHS.shape()[0]][R.vHS.shape()[1]]);
+  ComplexMatrix ovlp(extents[nwalk][2]);
+  ComplexMatrix ovlp_ref(extents[nwalk][2]);
+  for(int n=0; n<nwalk; n++) {
+    ovlp_ref[n][0] = R.W_data_out[n][2];
+    ovlp_ref[n][1] = R.W_data_out[n][3];
+  }
+
+  struct Stage {
+    std::string name;
+    std::function<void()> setup;
+    std::function<void()> kernel;
+    std::function<double()> error;
+  };
+  auto noop = [](){};
+  std::vector<Stage> stages;
+  stages.push_back(Stage{"density_matrix",
+    [&](){ AFQMCSys.invalidate_density_matrix(); },
+    [&](){ AFQMCSys.calculate_mixed_density_matrix(R.W,W_data,G,R.transposed_Spvn); },
+    [&](){ return relative_difference(G,R.G); }});
+  stages.push_back(Stage{"vbias", noop,
+    [&](){
+      if(R.transposed_Spvn)
+        base::get_vbias(opSpvnT,R.G,vbias,true);
+      else
+        base::get_vbias(opSpvn,R.G,vbias,false);
+    },
+    [&](){ return relative_difference(vbias,R.vbias); }});
+  stages.push_back(Stage{"vHS", noop,
+    [&](){
+      if(R.walker_major_vHS)
+        base::get_vHS_walker_major(opSpvn,R.X,vHS);
+      else
+        base::get_vHS(opSpvn,R.X,vHS);
+    },
+    [&](){ return relative_difference(vHS,R.vHS); }});
+  stages.push_back(Stage{"propagate",
+    [&](){ W = R.W; },
+    [&](){
+      if(R.merged_propg)
+        AFQMCSys.propagate_merged(W,opPropg2,R.vHS,R.walker_major_vHS);
+      else
+        AFQMCSys.propagate(W,opPropg1,R.vHS,R.walker_major_vHS);
+    },
+    [&](){ return relative_difference(W,R.W_out); }});
+  stages.push_back(Stage{"overlap", noop,
+    [&](){ AFQMCSys.calculate_overlaps(R.W_out,W_data); },
+    [&](){
+      for(int n=0; n<nwalk; n++) {
+        ovlp[n][0] = W_data[n][2];
+        ovlp[n][1] = W_data[n][3];
+      }
+      return relative_difference(ovlp,ovlp_ref);
+    }});
+
+  std::vector<std::string> selected;
+  {
+    std::string s(stage_list);
+    std::replace(s.begin(),s.end(),',',' ');
+    std::istringstream in(s);
+    std::string name;
+    while(in>>name) {
+      bool found = false;
+      for(auto& st: stages) found = found || (st.name == name);
+      if(!found) {
+        std::cerr<<" Error: Unknown stage: " <<name <<std::endl;
+        exit(1);
+      }
+      selected.push_back(name);
+    }
+  }
+
+  printf("%-16s  %-6s  %-11s  %-11s  %-11s  %-11s  %-11s  %s\n","Stage","Reps","Min","Median","P10","P90",
+         "Rel_error","Status");
+  int nfailed = 0;
+  for(auto& st: stages) {
+    if(selected.size() > 0 && std::find(selected.begin(),selected.end(),st.name) == selected.end())
+      continue;
+    std::vector<double> t = afqmc::time_kernel(st.setup,st.kernel,nrep);
+    double err = st.error();
+    bool ok = (err <= tolerance);
+    if(!ok) nfailed++;
+    printf("%-16s  %6d  %11.4e  %11.4e  %11.4e  %11.4e  %11.4e  %s\n",st.name.c_str(),nrep,t.front(),
+           afqmc::quantile(t,0.5),afqmc::quantile(t,0.1),afqmc::quantile(t,0.9),err,ok?"ok":"FAILED");
+  }
+
+  return (nfailed > 0)?1:0;
+}
@@ -0,0 +1,371 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+// -*- C++ -*-
+/** @file kernel_bench.cpp
+    @brief Microbenchmarks of the kernels of the AFQMC miniapp
+
+    Times every kernel of the miniapp in isolation on synthetic Hamiltonians,
+    over sweeps of NMO, NAEA, nchol, sparsity and number of walkers.
+    Each kernel is called once to warm up and then nrep times, the minimum, median,
+    10th and 90th percentiles of the times are written in csv format, together with
+    the GFLOP/s and GB/s at the median time from the costs in AFQMC/roofline.hpp.
+    The kernels that do not depend on the walkers (halfrotate_cholesky and compress)
+    are reported once per Hamiltonian, with nwalk=0.
+ */
+#include <Configuration.h>
+#include <Utilities/Clock.h>
+#include <getopt.h>
+#include <fstream>
+
+#include "AFQMC/afqmc_sys.hpp"
+#include "AFQMC/rotate.hpp"
+#include "AFQMC/vHS.hpp"
+#include "AFQMC/vbias.hpp"
+#include "AFQMC/roofline.hpp"
+#include "AFQMC/kernel_timing.hpp"
+#include "Matrix/synthetic_hamiltonian.hpp"
+#include "Numerics/ma_operations.hpp"
+
+using namespace std;
+using namespace qmcplusplus;
+
+void print_help()
+{
+  printf("kernel_bench - microbenchmarks of the kernels of the AFQMC miniapp\n");
+  printf("\n");
+  printf("Lists are comma separated, every combination is benchmarked.\n");
+  printf("Options:\n");
+  printf("-n                List of number of molecular orbitals (default: 40)\n");
+  printf("-e                List of number of electrons per spin (default: 8)\n");
+  printf("-c                List of number of Cholesky vectors (default: 120)\n");
+  printf("-s                List of sparsities of the Cholesky vectors (default: 0.2)\n");
+  printf("-w                List of number of walkers (default: 1,4,16)\n");
+  printf("-k                List of kernels (default: all)\n");
+  printf("-r                Number of timed repetitions of each kernel (default: 10)\n");
+  printf("-o                Output file (default: kernel_bench.csv)\n");
+  printf("\n");
+  printf("Kernels: MixedDensityMatrix, MixedDensityMatrix_full, Overlap, get_vbias, get_vbias_T,\n");
+  printf("         get_vHS, get_vHS_walker_major, apply_expM, apply_expM_batched, propagate,\n");
+  printf("         orthogonalize, calculate_energy, halfrotate_cholesky, compress\n");
+}
+
+template<class T>
+std::vector<T> parse_list(const std::string& s)
+{
+  std::vector<T> v;
+  std::string str(s);
+  std::replace(str.begin(),str.end(),',',' ');
+  std::istringstream in(str);
+  T a;
+  while(in>>a) v.push_back(a);
+  return v;
+}
+
+struct BenchConfig
+{
+  int NMO;
+  int NAEA;
+  int nchol;
+  double sparsity;
+};
+
+void write_row(std::ostream& out, const std::string& kernel, const BenchConfig& c, int nwalk,
+               const std::vector<double>& t, const afqmc::KernelCost& cost)
+{
+  double tmed = afqmc::quantile(t,0.5);
+  out<<kernel <<"," <<c.NMO <<"," <<c.NAEA <<"," <<c.nchol <<"," <<c.sparsity <<"," <<nwalk <<","
+     <<t.size() <<"," <<t.front() <<"," <<tmed <<"," <<afqmc::quantile(t,0.1) <<"," <<afqmc::quantile(t,0.9) <<","
+     <<(tmed>0.0?cost.flops/tmed/1e9:0.0) <<"," <<(tmed>0.0?cost.bytes/tmed/1e9:0.0) <<"\n";
+  out.flush();
+}
+
+int main(int argc, char **argv)
+{
+
+#ifndef QMC_COMPLEX
+  std::cerr<<" Error: Please compile complex executable, QMC_COMPLEX=1. " <<std::endl;
+  exit(1);
+#endif
+
+  std::vector<int> NMO_list(1,40), NAEA_list(1,8), nchol_list(1,120), nwalk_list;
+  std::vector<double> sparsity_list(1,0.2);
+  std::vector<std::string> kernels;
+  nwalk_list.push_back(1);
+  nwalk_list.push_back(4);
+  nwalk_list.push_back(16);
+  int nrep = 10;
+  const double dt = 0.01;
+  const int nspin = 2;
+  std::string out_file = "kernel_bench.csv";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hn:e:c:s:w:k:r:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h': print_help(); return 1;
+    case 'n':
+      NMO_list = parse_list<int>(optarg);
+      break;
+    case 'e':
+      NAEA_list = parse_list<int>(optarg);
+      break;
+    case 'c':
+      nchol_list = parse_list<int>(optarg);
+      break;
+    case 's':
+      sparsity_list = parse_list<double>(optarg);
+      break;
+    case 'w':
+      nwalk_list = parse_list<int>(optarg);
+      break;
+    case 'k':
+      kernels = parse_list<std::string>(optarg);
+      break;
+    case 'r':
+      nrep = atoi(optarg);
+      break;
+    case 'o':
+      out_file = std::string(optarg);
+      break;
+    }
+  }
+  if(nrep < 1) nrep = 1;
+
+  auto run = [&](const std::string& name) {
+    return kernels.size()==0 || std::find(kernels.begin(),kernels.end(),name) != kernels.end();
+  };
+
+  std::ofstream out(out_file.c_str());
+  if(out.fail()) {
+    std::cerr<<" Error: problems opening output file: " <<out_file <<std::endl;
+    exit(1);
+  }
+  out<<"kernel,NMO,NAEA,nchol,sparsity,nwalk,nrep,min,median,p10,p90,GFLOPs,GBs\n";
+  std::cout<<"  Writing results to " <<out_file <<"\n";
+
+  auto noop = [](){};
+
+  for(int NMO: NMO_list)
+  for(int NAEA: NAEA_list)
+  for(int nchol: nchol_list)
+  for(double sparsity: sparsity_list)
+  {
+    afqmc::SyntheticParameters p;
+    p.NMO = NMO;
+    p.NAEA = NAEA;
+    p.nchol = nchol;
+    p.sparsity = sparsity;
+    if(!p.valid()) {
+      std::cerr<<" Skipping invalid parameters NMO, NAEA, nchol, sparsity: "
+               <<NMO <<", " <<NAEA <<", " <<nchol <<", " <<sparsity <<std::endl;
+      continue;
+    }
+    BenchConfig cfg{NMO,NAEA,nchol,sparsity};
+
+    base::afqmc_sys AFQMCSys;
+    ComplexSpMat Spvn, SpvnT, Vakbl;
+    ComplexMatrix haj, Propg1;
+    {
+      afqmc::SyntheticHamiltonian H;
+      afqmc::generate_hamiltonian(p,dt,H);
+      if(!afqmc::Initialize(H,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+        std::cerr<<" Error initalizing data structures from synthetic Hamiltonian. " <<std::endl;
+        exit(1);
+      }
+    }
+    base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,AFQMCSys.trialwfn_beta,Spvn,SpvnT);
+
+    const ComplexMatOp opSpvn(Spvn);
+    const ComplexMatOp opSpvnT(SpvnT);
+    const ComplexMatOp opVakbl(Vakbl);
+    const ComplexMatOp opPropg1(Propg1);
+    const double M = NMO, N = NAEA;
+    const int NAK = 2*NAEA*NMO;
+    const int NIK = 2*NMO*NMO;
+
+    std::cout<<"  NMO, NAEA, nchol, sparsity: " <<NMO <<", " <<NAEA <<", " <<nchol <<", " <<sparsity
+             <<"  nnz(Spvn), nnz(SpvnT), nnz(Vakbl): " <<Spvn.size() <<", " <<SpvnT.size() <<", " <<Vakbl.size() <<"\n";
+
+    if(run("halfrotate_cholesky")) {
+      // per Cholesky vector, two passes with nspin products [N][M]x[M][M]
+      afqmc::KernelCost c{2.0*nspin*8.0*N*M*M*nchol,
+                          afqmc::storage_bytes(opSpvn)+afqmc::storage_bytes(opSpvnT)};
+      ComplexSpMat B;
+      auto t = afqmc::time_kernel(noop, [&](){
+                 base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,AFQMCSys.trialwfn_beta,Spvn,B);
+               }, nrep);
+      write_row(out,"halfrotate_cholesky",cfg,0,t,c);
+    }
+
+    if(run("compress")) {
+      // the elements of Spvn in random order
+      std::vector<std::tuple<int,int,ComplexType>> elements;
+      elements.reserve(Spvn.size());
+      auto col = Spvn.indx();
+      auto val = Spvn.val();
+      for(int i=0; i<Spvn.rows(); i++)
+        for(auto k=*(Spvn.pntrb()+i); k<*(Spvn.pntre()+i); k++)
+          elements.push_back(std::make_tuple(i,*(col+k),*(val+k)));
+      std::shuffle(elements.begin(),elements.end(),std::mt19937(p.seed));
+      // sort of the (row,col,val) arrays, counted as one read and one write of each element
+      afqmc::KernelCost c{0.0, 2.0*elements.size()*(sizeof(ComplexType)+2*sizeof(int))};
+      ComplexSpMat A;
+      auto t = afqmc::time_kernel([&](){
+                 A.clear();
+                 A.setDims(Spvn.rows(),Spvn.cols());
+                 A.reserve(elements.size());
+                 A.add(elements);
+               }, [&](){ A.compress(); }, nrep);
+      write_row(out,"compress",cfg,0,t,c);
+    }
+
+    for(int nwalk: nwalk_list) {
+      if(nwalk < 1) continue;
+
+      // walkers: trial wave function with a random perturbation
+      WalkerContainer W(extents[nwalk][nspin][NMO][NAEA]);
+      ComplexMatrix W_data(extents[nwalk][8]);
+      std::mt19937 gen(p.seed+nwalk);
+      std::normal_distribution<double> normal(0.0,1.0);
+      for(int n=0; n<nwalk; n++) {
+        for(int nm=0; nm<NMO; nm++)
+          for(int na=0; na<NAEA; na++) {
+            using std::conj;
+            W[n][0][nm][na] = conj(AFQMCSys.trialwfn_alpha[nm][na]) + 0.1*ComplexType(normal(gen),normal(gen));
+            W[n][1][nm][na] = conj(AFQMCSys.trialwfn_beta[nm][na]) + 0.1*ComplexType(normal(gen),normal(gen));
+          }
+        W_data[n][1] = ComplexType(1.);
+      }
+      AFQMCSys.orthogonalize(W);
+      WalkerContainer W0(W);
+
+      ComplexMatrix G(extents[NIK][nwalk]);
+      ComplexMatrix Gc(extents[NAK][nwalk]);
+      ComplexMatrix vbias(extents[nchol][nwalk]);
+      ComplexMatrix X(extents[nchol][nwalk]);
+      ComplexMatrix vHS(extents[NMO*NMO][nwalk]);
+      ComplexMatrix vHS_wm(extents[nwalk][NMO*NMO]);
+      for(auto it=X.data(), ite=X.data()+X.num_elements(); it!=ite; ++it)
+        *it = ComplexType(normal(gen),0.0);
+
+      AFQMCSys.calculate_mixed_density_matrix(W,W_data,G,false);
+      AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
+      base::get_vHS(opSpvn,X,vHS);
+      base::get_vHS_walker_major(opSpvn,X,vHS_wm);
+
+      if(run("MixedDensityMatrix")) {
+        auto t = afqmc::time_kernel([&](){ AFQMCSys.invalidate_density_matrix(); },
+                             [&](){ AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true); }, nrep);
+        write_row(out,"MixedDensityMatrix",cfg,nwalk,t,afqmc::density_matrix_cost(NMO,NAEA,nspin,nwalk,true));
+      }
+
+      if(run("MixedDensityMatrix_full")) {
+        auto t = afqmc::time_kernel([&](){ AFQMCSys.invalidate_density_matrix(); },
+                             [&](){ AFQMCSys.calculate_mixed_density_matrix(W,W_data,G,false); }, nrep);
+        write_row(out,"MixedDensityMatrix_full",cfg,nwalk,t,afqmc::density_matrix_cost(NMO,NAEA,nspin,nwalk,false));
+      }
+      // the timed calls leave the density matrices of W in G and Gc
+      AFQMCSys.invalidate_density_matrix();
+      AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
+
+      if(run("Overlap")) {
+        auto t = afqmc::time_kernel(noop, [&](){ AFQMCSys.calculate_overlaps(W,W_data); }, nrep);
+        write_row(out,"Overlap",cfg,nwalk,t,afqmc::overlap_cost(NMO,NAEA,nspin,nwalk));
+      }
+
+      if(run("get_vbias")) {
+        auto t = afqmc::time_kernel(noop, [&](){ base::get_vbias(opSpvn,G,vbias,false); }, nrep);
+        write_row(out,"get_vbias",cfg,nwalk,t,afqmc::product_cost(opSpvn,nwalk));
+      }
+
+      if(run("get_vbias_T")) {
+        auto t = afqmc::time_kernel(noop, [&](){ base::get_vbias(opSpvnT,Gc,vbias,true); }, nrep);
+        write_row(out,"get_vbias_T",cfg,nwalk,t,afqmc::product_cost(opSpvnT,nwalk));
+      }
+
+      if(run("get_vHS")) {
+        auto t = afqmc::time_kernel(noop, [&](){ base::get_vHS(opSpvn,X,vHS); }, nrep);
+        write_row(out,"get_vHS",cfg,nwalk,t,afqmc::product_cost(opSpvn,nwalk));
+      }
+
+      if(run("get_vHS_walker_major")) {
+        auto t = afqmc::time_kernel(noop, [&](){ base::get_vHS_walker_major(opSpvn,X,vHS_wm); }, nrep);
+        write_row(out,"get_vHS_walker_major",cfg,nwalk,t,afqmc::product_cost(opSpvn,nwalk));
+      }
+
+      // exp(vHS) applied with a Taylor expansion of order 6 to the walkers, as in propagate
+      afqmc::KernelCost expM_cost{nspin*nwalk*8.0*6*M*M*N,
+                                  (nwalk*M*M + 2.0*nspin*nwalk*M*N)*sizeof(ComplexType)};
+
+      if(run("apply_expM")) {
+        // the exponential of every walker and spin has its own copy of vHS and of the walker,
+        // filled outside of the timed region as in apply_expM_batched
+        std::vector<ComplexMatrix> V(nwalk,ComplexMatrix(extents[NMO][NMO]));
+        std::vector<ComplexMatrix> S(nwalk*nspin,ComplexMatrix(extents[NMO][NAEA]));
+        ComplexMatrix T1(extents[NMO][NAEA]);
+        ComplexMatrix T2(extents[NMO][NAEA]);
+        boost::const_multi_array_ref<ComplexType,3> V3(vHS.data(), extents[NMO][NMO][nwalk]);
+        for(int nw=0; nw<nwalk; nw++)
+          V[nw] = V3[ indices[range_t(0,NMO)][range_t(0,NMO)][nw] ];
+        auto t = afqmc::time_kernel([&](){
+                   for(int nw=0; nw<nwalk; nw++)
+                     for(int s=0; s<nspin; s++)
+                       S[nw*nspin+s] = W0[nw][s];
+                 }, [&](){
+                   for(int nw=0; nw<nwalk; nw++)
+                     for(int s=0; s<nspin; s++)
+                       base::apply_expM(V[nw],S[nw*nspin+s],T1,T2,6);
+                 }, nrep);
+        write_row(out,"apply_expM",cfg,nwalk,t,expM_cost);
+      }
+
+      if(run("apply_expM_batched")) {
+        boost::multi_array<ComplexType,3> S(extents[nwalk][NMO][nspin*NAEA]);
+        boost::multi_array<ComplexType,3> T1(extents[nwalk][NMO][nspin*NAEA]);
+        boost::multi_array<ComplexType,3> T2(extents[nwalk][NMO][nspin*NAEA]);
+        boost::const_multi_array_ref<ComplexType,3> V(vHS_wm.data(), extents[nwalk][NMO][NMO]);
+        auto t = afqmc::time_kernel([&](){
+                   for(int nw=0; nw<nwalk; nw++)
+                     for(int s=0; s<nspin; s++)
+                       S[nw][ indices[range_t(0,NMO)][range_t(s*NAEA,(s+1)*NAEA)] ] = W0[nw][s];
+                 }, [&](){ base::apply_expM_batched(V,S,T1,T2,6); }, nrep);
+        write_row(out,"apply_expM_batched",cfg,nwalk,t,expM_cost);
+      }
+
+      if(run("propagate")) {
+        auto t = afqmc::time_kernel([&](){ W = W0; },
+                             [&](){ AFQMCSys.propagate(W,opPropg1,vHS_wm,true); }, nrep);
+        write_row(out,"propagate",cfg,nwalk,t,
+                  afqmc::propagation_cost(&opPropg1,opPropg1,NMO,NAEA,nspin,nwalk));
+        W = W0;
+      }
+
+      if(run("orthogonalize")) {
+        auto t = afqmc::time_kernel([&](){ W = W0; }, [&](){ AFQMCSys.orthogonalize(W); }, nrep);
+        write_row(out,"orthogonalize",cfg,nwalk,t,afqmc::orthogonalization_cost(NMO,NAEA,nspin,nwalk));
+        W = W0;
+      }
+
+      if(run("calculate_energy")) {
+        auto t = afqmc::time_kernel(noop, [&](){ AFQMCSys.calculate_energy(W_data,Gc,haj,opVakbl); }, nrep);
+        write_row(out,"calculate_energy",cfg,nwalk,t,afqmc::energy_cost(opVakbl,nwalk));
+      }
+
+    }
+  }
+
+  return 0;
+}
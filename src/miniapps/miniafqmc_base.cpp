@@ -28,6 +28,7 @@
  */
 // clang-format on
 #include <random>
+#include <numeric>
 
 #include <Configuration.h>
 #include <Utilities/PrimeNumberSet.h>
@@ -38,11 +39,17 @@
 
 #include "AFQMC/afqmc_sys.hpp"
 #include "Matrix/initialize_serial.hpp"
+#include "Matrix/synthetic_hamiltonian.hpp"
 #include "AFQMC/rotate.hpp"
 #include "AFQMC/mixed_density_matrix.hpp"
 #include "AFQMC/energy.hpp"
 #include "AFQMC/vHS.hpp"
 #include "AFQMC/vbias.hpp"
+#include "AFQMC/kernel_selection.hpp"
+#include "AFQMC/autotune.hpp"
+#include "AFQMC/roofline.hpp"
+#include "AFQMC/substep_record.hpp"
+#include "AFQMC/telemetry.hpp"
 
 using namespace std;
 using namespace qmcplusplus;
@@ -85,8 +92,29 @@ void print_help()
   printf("-s                Number of substeps (default: 10)\n");
   printf("-w                Number of walkers (default: 16)\n");
   printf("-o                Number of substeps between orthogonalization (default: 10)\n");
+  printf("-l                Layout of the H-S potential: walker ([nwalk][NMO*NMO]) or orbital ([NMO*NMO][nwalk]) (default: walker)\n");
+  printf("-p                Schedule of the one-body half-steps: split (Propg1 before and after exp(vHS)) or merged (Propg1*Propg1 between substeps) (default: split)\n");
+  printf("-e                Cutoff of the sparse one-body propagator, elements below it are dropped, negative for dense storage (default: 1e-8)\n");
+  printf("-r                If set to no, do not use the closed shell fast path (one spin per walker) for restricted trial wave functions (default yes)\n");
+  printf("-k                Number of walkers in the blocks of the propagation pipeline, 0 to fit the blocks in cache (default: all walkers)\n");
   printf("-f                Input file name (default: ./afqmc.h5)\n"); 
+  printf("-g                Use a synthetic Hamiltonian instead of the input file: NMO,NAEA,nchol[,sparsity[,block[,model]]], model: random or hubbard (see afqmc_gen)\n"); 
   printf("-t                If set to no, do not use half-rotated transposed Cholesky matrix to calculate bias potential (default yes).\n"); 
+  printf("-m                Storage format of the sparse matrices: csr, bsr, sell, dcsr (csr with 16-bit column deltas) (default: csr)\n"); 
+  printf("-b                Block size of bsr format, slice height of sell format (default: 4)\n"); 
+  printf("-c                Compact sparse matrices: release the COO row arrays after construction\n"); 
+  printf("-d                Dense storage of the sparse matrices: auto (when predicted to be faster), yes, no (default: auto)\n"); 
+  printf("-a                Autotune the storage formats, the walker block size and the vHS layout and store them in the tuning database\n"); 
+  printf("-T                Tuning database, its storage formats are used unless -m, -b or -d are given, its walker block size unless -k is given and its vHS layout unless -l is given (default: ./afqmc_tuning.txt)\n"); 
+  printf("-H                Collect hardware performance counters (cycles, instructions, LLC misses) in the timers\n");
+  printf("-R                Measure the peak gemm throughput and memory bandwidth (STREAM triad) for the roofline profile\n");
+  printf("-J                Record the timer events and write them to this file in Chrome trace-event format\n");
+  printf("-B                Benchmark mode: record one sample of every timer per step (the first step is not recorded) and write them to this baseline file\n");
+  printf("-C                Benchmark mode: compare the timer samples with this baseline file, exit with code 2 on regressions\n");
+  printf("-x                Relative slowdown of the median time of a timer reported as a regression by -C (default: 0.05)\n");
+  printf("-S                Record the walkers and the results of all stages of one substep to this file, for afqmc_replay\n");
+  printf("-n                Step and substep recorded by -S: step,substep (default: 0,0)\n");
+  printf("-E                Write a telemetry record per step (stage times, energy, weights, overlaps) to this file, JSON lines if it ends in .json or .jsonl, csv otherwise\n");
   printf("-v                Verbose output\n");
 }
 
@@ -102,13 +130,50 @@ int main(int argc, char **argv)
   int nsubsteps=10; 
   int nwalk=16;
   int northo = 10;
+  int walker_block = -1;  // < 0: all walkers, 0: sized to the cache  
   const double dt = 0.01;  // 1-body propagators are assumed to be generated with a timestep = 0.01
 
   bool verbose = false;
   int iseed   = 11;
   std::string init_file = "afqmc.h5";
+  std::string synthetic_spec = "";
 
   bool transposed_Spvn = true;
+  bool walker_major_vHS = true;
+  bool merged_propg = false;  // walkers are kept half a step behind, see AFQMCSys::propagate_merged
+  bool compact_sparse = false;
+  // the one-body propagator is stored sparse, with elements below propg_cutoff dropped, 
+  // when the sparse product is predicted to be faster 
+  double propg_cutoff = 1e-8;
+  // walkers of restricted closed shell trial wave functions are stored with a single spin 
+  bool use_closed_shell = true;
+
+  std::string sp_format = "csr";
+  int bsr_block = 4;
+  // bsr matrices with a smaller fraction of non-zero values in the blocks fall back to csr 
+  const double min_bsr_fill = 0.5;
+  // rows of sell matrices are sorted by length within windows of sell_sigma*bsr_block rows
+  const int sell_sigma = 32;
+  std::string dense_mode = "auto";
+  // sparse matrices larger than this are never stored as dense matrices (in bytes)
+  const double max_dense_memory = 2048.0*1024.0*1024.0;
+  // formats given explicitly with -m, -b or -d, block size with -k and layout with -l take precedence over the tuning database
+  bool user_format = false;
+  bool user_walker_block = false;
+  bool user_layout = false;
+  bool autotune = false;
+  std::string tuning_file = "afqmc_tuning.txt";
+  bool hw_counters = false;
+  bool calibrate_peak = false;
+  std::string trace_file = "";
+  // number of timer events kept per thread in the event trace 
+  const long trace_capacity = 1l<<18;
+  std::string baseline_out = "";
+  std::string baseline_in = "";
+  double regression_threshold = 0.05;
+  std::string snapshot_file = "";
+  int snapshot_step = 0, snapshot_substep = 0;
+  std::string telemetry_file = "";
 
   ComplexType one(1.),zero(0.),half(0.5);
   ComplexType cone(1.),czero(0.);
@@ -117,7 +182,7 @@ int main(int argc, char **argv)
 
   char *g_opt_arg;
   int opt;
-  while ((opt = getopt(argc, argv, "thvi:s:w:o:f:")) != -1)
+  while ((opt = getopt(argc, argv, "hvcaHRt:i:s:w:o:k:l:p:e:r:f:g:m:b:d:T:J:B:C:x:S:n:E:")) != -1)
   {
     switch (opt)
     {
@@ -134,12 +199,77 @@ int main(int argc, char **argv)
     case 'o': // the number of sub steps for drift/diffusion
       northo = atoi(optarg);
       break;
+    case 'l':
+      walker_major_vHS = (std::string(optarg) != "orbital");
+      user_layout = true;
+      break;
+    case 'p':
+      merged_propg = (std::string(optarg) == "merged");
+      break;
+    case 'e':
+      propg_cutoff = atof(optarg);
+      break;
+    case 'r':
+      use_closed_shell = (std::string(optarg) != "no");
+      break;
+    case 'k':
+      walker_block = atoi(optarg);
+      user_walker_block = true;
+      break;
     case 't':
       transposed_Spvn = (std::string(optarg) != "no");
       break;
     case 'f':
       init_file = std::string(optarg);
+      break;
+    case 'g':
+      synthetic_spec = std::string(optarg);
+      break;    
+    case 'm':
+      sp_format = std::string(optarg);
+      user_format = true;
+      break;    
+    case 'b':
+      bsr_block = atoi(optarg);
+      user_format = true;
       break;    
+    case 'd':
+      dense_mode = std::string(optarg);
+      user_format = true;
+      break;    
+    case 'a': autotune = true; 
+      break;
+    case 'T':
+      tuning_file = std::string(optarg);
+      break;    
+    case 'J':
+      trace_file = std::string(optarg);
+      break;    
+    case 'B':
+      baseline_out = std::string(optarg);
+      break;    
+    case 'C':
+      baseline_in = std::string(optarg);
+      break;    
+    case 'x':
+      regression_threshold = atof(optarg);
+      break;    
+    case 'S':
+      snapshot_file = std::string(optarg);
+      break;    
+    case 'E':
+      telemetry_file = std::string(optarg);
+      break;    
+    case 'n':
+      if(sscanf(optarg,"%d,%d",&snapshot_step,&snapshot_substep) != 2)
+        APP_ABORT(" Error: Expected step,substep in -n. \n");
+      break;    
+    case 'c': compact_sparse = true; 
+      break;
+    case 'H': hw_counters = true; 
+      break;
+    case 'R': calibrate_peak = true; 
+      break;
     case 'v': verbose  = true; 
       break;
     }
@@ -152,6 +282,8 @@ int main(int argc, char **argv)
   RandomGenerator<RealType> random_th(myPrimes[ip]);
 
   TimerManager.set_timer_threshold(timer_level_coarse);
+  // opened before the OpenMP threads are created, so that their events are counted  
+  int hw_counters_available = hw_counters?TimerManager.enable_hardware_counters():0;
   TimerList_t Timers;
   setup_timers(Timers, MiniQMCTimerNames, timer_level_coarse);
 
@@ -162,34 +294,264 @@ int main(int argc, char **argv)
   ComplexMatrix haj;    // 1-Body Hamiltonian Matrix
   ComplexSpMat Vakbl;   // 2-Body Hamiltonian Matrix: (Half-Rotated) 2-electron integrals 
   ComplexMatrix Propg1;   // propagator for 1-body hamiltonian 
+  typedef afqmc::MatrixStorage<ComplexType,SpPtrType> ComplexMatStorage;
+  ComplexMatStorage stSpvn;    // Spvn in the format used in the kernels 
+  ComplexMatStorage stSpvnT;   // SpvnT in the format used in the kernels 
+  ComplexMatStorage stVakbl;   // Vakbl in the format used in the kernels 
 
 //  index_gen indices;
 
-  hdf_archive dump;
-  if(!dump.open(init_file,H5F_ACC_RDONLY)) 
-    APP_ABORT("Error: problems opening hdf5 file. \n");
+  if(synthetic_spec != "") {
 
-  std::cout<<"***********************************************************\n";
-  std::cout<<"                 Initializing from HDF5                    \n"; 
-  std::cout<<"***********************************************************\n";
+    afqmc::SyntheticParameters params;
+    if(!params.parse(synthetic_spec))
+      APP_ABORT(" Error: Invalid synthetic Hamiltonian. Expected NMO,NAEA,nchol[,sparsity[,block[,random|hubbard]]]. \n");
+
+    std::cout<<"***********************************************************\n";
+    std::cout<<"           Initializing synthetic Hamiltonian              \n"; 
+    std::cout<<"***********************************************************\n";
+
+    afqmc::SyntheticHamiltonian H;
+    afqmc::generate_hamiltonian(params,dt,H);
+    if(!afqmc::Initialize(H,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+      std::cerr<<" Error initalizing data structures from synthetic Hamiltonian: " <<synthetic_spec <<std::endl;
+      exit(1);
+    }
+
+  } else {
+
+    hdf_archive dump;
+    if(!dump.open(init_file,H5F_ACC_RDONLY)) 
+      APP_ABORT("Error: problems opening hdf5 file. \n");
+
+    std::cout<<"***********************************************************\n";
+    std::cout<<"                 Initializing from HDF5                    \n"; 
+    std::cout<<"***********************************************************\n";
+
+    if(!afqmc::Initialize(dump,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+      std::cerr<<" Error initalizing data structures from hdf5 file: " <<init_file <<std::endl;
+      exit(1);
+    }
 
-  if(!afqmc::Initialize(dump,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
-    std::cerr<<" Error initalizing data structures from hdf5 file: " <<init_file <<std::endl;
-    exit(1);
   }
 
+  // closed shell: both spins of the walkers are identical, only one is stored and propagated 
+  // and SpvnT holds a single (scaled) copy of the spin blocks 
+  bool closed_shell = use_closed_shell && AFQMCSys.is_closed_shell();
+  int nspin = closed_shell?1:2;
+
   if(transposed_Spvn) base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,
                                                  AFQMCSys.trialwfn_beta,   
                                                  Spvn,
-                                                 SpvnT   
+                                                 SpvnT,   
+                                                 1e-6,
+                                                 closed_shell
                                                 );
 
   RealType Eshift = 0;
   int NMO = AFQMCSys.NMO;              // number of molecular orbitals
   int NAEA = AFQMCSys.NAEA;            // number of up electrons
   int nchol = Spvn.cols();            // number of cholesky vectors  
-  int NIK = 2*NMO*NMO;                // dimensions of linearized green function
   int NAK = 2*NAEA*NMO;               // dimensions of linearized "compacted" green function
+  int NIKs = nspin*NMO*NMO;           // dimensions of the green functions of the stored spins  
+  int NAKs = nspin*NAEA*NMO;           
+
+  // walkers are propagated in blocks of walker_block walkers, all the data of a block (DM, vbias, X and vHS)
+  // fits in cache when sized with -k 0 
+  int cache_block = std::min(nwalk, afqmc::cache_walker_block( sizeof(ComplexType)*
+                      (double(NMO)*NMO + (transposed_Spvn?NAKs:NIKs) + 2.0*nchol + double(nspin)*NMO*NAEA) ));
+  if(walker_block == 0) walker_block = cache_block; 
+  if(walker_block < 0 || walker_block > nwalk) walker_block = nwalk;
+
+  if(sp_format != "csr" && sp_format != "bsr" && sp_format != "sell" && sp_format != "dcsr")
+    APP_ABORT(" Error: Unknown sparse format. Options: csr, bsr, sell, dcsr. \n");
+  if(bsr_block < 1)
+    APP_ABORT(" Error: bsr block size must be positive. \n");
+  if(dense_mode != "auto" && dense_mode != "yes" && dense_mode != "no")
+    APP_ABORT(" Error: Unknown dense storage mode. Options: auto, yes, no. \n");
+
+  // storage format of each matrix, from the command line or from the tuning database
+  // Spvn and SpvnT multiply a block of walkers, Vakbl all the walkers
+  afqmc::TunedFormat fmt_Spvn{sp_format,bsr_block,0.0};
+  afqmc::TunedFormat fmt_SpvnT{sp_format,bsr_block,0.0};
+  afqmc::TunedFormat fmt_Vakbl{(sp_format=="bsr")?std::string("csr"):sp_format,bsr_block,0.0};
+
+  afqmc::TuningDatabase tuning_db;
+  std::string machine_sig = afqmc::machine_signature();
+  std::string problem_sig = afqmc::problem_signature(AFQMCSys.NMO,AFQMCSys.NAEA,Spvn.cols(),Spvn.size(),Vakbl.size(),
+                                                     nwalk,transposed_Spvn);
+  tuning_db.load(tuning_file);
+  bool tuned = false;
+  // walker block size or vHS layout from the tuning database or the tuner
+  bool tuned_pipeline = false;
+  if(autotune) {
+    std::cout<<"\n  Autotuning storage formats (format:block  time per call (s)): \n";
+    std::cout<<"  Spvn: \n";
+    fmt_Spvn = afqmc::tune_format(Spvn,walker_block,!transposed_Spvn,max_dense_memory,sell_sigma,std::cout);
+    if(transposed_Spvn) {
+      std::cout<<"  SpvnT: \n";
+      fmt_SpvnT = afqmc::tune_format(SpvnT,walker_block,false,max_dense_memory,sell_sigma,std::cout);
+    }
+    std::cout<<"  Vakbl: \n";
+    fmt_Vakbl = afqmc::tune_format(Vakbl,nwalk,false,max_dense_memory,sell_sigma,std::cout);
+    afqmc::TuningDatabase::params_type params;
+    params["Spvn"] = fmt_Spvn.str();
+    if(transposed_Spvn) params["SpvnT"] = fmt_SpvnT.str();
+    params["Vakbl"] = fmt_Vakbl.str();
+    tuning_db.store(machine_sig,problem_sig,params);
+    if(!tuning_db.save(tuning_file))
+      std::cerr<<" Warning: Problems writing tuning database: " <<tuning_file <<std::endl;
+    tuned = true;
+  } else {
+    afqmc::TuningDatabase::params_type params;
+    if(tuning_db.find(machine_sig,problem_sig,params)) {
+      if(!user_format) {
+        if(params.count("Spvn")) fmt_Spvn = afqmc::TunedFormat::parse(params["Spvn"]);
+        if(params.count("SpvnT")) fmt_SpvnT = afqmc::TunedFormat::parse(params["SpvnT"]);
+        if(params.count("Vakbl")) fmt_Vakbl = afqmc::TunedFormat::parse(params["Vakbl"]);
+        tuned = true;
+      }
+      if(!user_walker_block && params.count("walker_block")) {
+        walker_block = std::max(1,std::min(nwalk,atoi(params["walker_block"].c_str())));
+        tuned_pipeline = true;
+      }
+      if(!user_layout && params.count("vHS_layout")) {
+        walker_major_vHS = (params["vHS_layout"] != "orbital");
+        tuned_pipeline = true;
+      }
+    }
+  }
+
+  // bsr matrices with a low block fill fall back to csr, unless chosen by the tuner 
+  auto set_format = [&](ComplexMatStorage& S, const ComplexSpMat& A, const afqmc::TunedFormat& f) {
+    double fill = S.set_format(A,f.format,f.block,sell_sigma);
+    if(f.format == "bsr" && fill < min_bsr_fill && !tuned) S.clear();
+    return fill;
+  };
+  double fill_Spvn = set_format(stSpvn,Spvn,fmt_Spvn);
+  double fill_SpvnT = transposed_Spvn?set_format(stSpvnT,SpvnT,fmt_SpvnT):1.0;
+  double fill_Vakbl = set_format(stVakbl,Vakbl,fmt_Vakbl);
+
+  unsigned long reclaimed = 0;
+  if(compact_sparse) {
+    reclaimed += Spvn.setCompact();
+    reclaimed += SpvnT.setCompact();
+    reclaimed += Vakbl.setCompact();
+  }
+
+  // switch to dense storage when the dense product is predicted to be faster 
+  // returns the predicted ratio between the dense and sparse times
+  auto select_dense = [&](ComplexMatStorage& S, const ComplexSpMat& A, int ncol) {
+    if(tuned || dense_mode == "no" || A.rows() == 0) return 1.0;
+    double ratio = afqmc::dense_to_sparse_time_ratio(S.op(),ncol);
+    if( (dense_mode == "yes" || ratio < 1.0) && 
+        double(A.rows())*double(A.cols())*sizeof(ComplexType) <= max_dense_memory ) 
+      S.set_format(A,"dense");
+    return ratio;
+  };
+  double dense_ratio_Spvn = select_dense(stSpvn,Spvn,walker_block);
+  double dense_ratio_SpvnT = transposed_Spvn?select_dense(stSpvnT,SpvnT,walker_block):1.0;
+  double dense_ratio_Vakbl = select_dense(stVakbl,Vakbl,nwalk);
+
+  // operators used in the kernels
+  const ComplexMatOp& opSpvn = stSpvn.op(); 
+  const ComplexMatOp& opSpvnT = stSpvnT.op(); 
+  const ComplexMatOp& opVakbl = stVakbl.op(); 
+
+  // one-body propagators: Propg1 and, with merged half-steps, Propg2 = Propg1 * Propg1
+  ComplexMatrix Propg2(extents[merged_propg?Propg1.shape()[0]:0][merged_propg?Propg1.shape()[1]:0]);
+  if(merged_propg) ma::product(Propg1,Propg1,Propg2);
+  ComplexSpMat Propg1_sp, Propg2_sp;
+  struct PropgStorage {
+    ComplexMatOp op;
+    double sparsity, err_max, err_fro, ratio;
+  };
+  // thresholds P and keeps the sparse matrix if the sparse product is predicted to be faster 
+  auto select_propagator = [&](const ComplexMatrix& P, ComplexSpMat& Psp) {
+    PropgStorage p{ComplexMatOp(P),1.0,0.0,0.0,1.0};
+    if(propg_cutoff < 0.0 || P.num_elements() == 0) return p;
+    p.err_max = afqmc::threshold_to_sparse(P,propg_cutoff,Psp,p.err_fro);
+    p.sparsity = Psp.size()/double(P.num_elements());
+    p.ratio = afqmc::dense_to_sparse_time_ratio(ComplexMatOp(Psp),AFQMCSys.NAEA);
+    if(p.ratio < 1.0) 
+      Psp.clear();
+    else
+      p.op = ComplexMatOp(Psp);
+    return p;
+  };
+  PropgStorage stPropg1 = select_propagator(Propg1,Propg1_sp);
+  PropgStorage stPropg2 = select_propagator(Propg2,Propg2_sp);
+  const ComplexMatOp& opPropg1 = stPropg1.op; 
+  const ComplexMatOp& opPropg2 = stPropg2.op; 
+
+  // blocks of walkers and block buffers, re-interpreted with the size of the block
+  typedef boost::multi_array_ref<ComplexType,2> ComplexMatrixRef;
+  typedef boost::multi_array_ref<ComplexType,4> WalkerContainerRef;
+
+  // walker block size and vHS layout, tuned with the storage formats and propagators selected above.
+  // A pass propagates trial walkers once with X=0 (vHS=0), the cost of the kernels does not depend on the values.
+  if(autotune) {
+    auto time_pass = [&](int wb, bool walker_major) {
+      WalkerContainer Wt(extents[nwalk][nspin][NMO][NAEA]);
+      ComplexMatrix Wt_data(extents[nwalk][8]);
+      for(int n=0; n<nwalk; n++) 
+        for(int nm=0; nm<NMO; nm++) 
+          for(int na=0; na<NAEA; na++) {
+            using std::conj;
+            Wt[n][0][nm][na] = conj(AFQMCSys.trialwfn_alpha[nm][na]);
+            if(nspin == 2) Wt[n][1][nm][na] = conj(AFQMCSys.trialwfn_beta[nm][na]);
+          }
+      ComplexMatrix Gt(extents[transposed_Spvn?NAKs:NIKs][wb]);
+      ComplexMatrix vbiast(extents[nchol][wb]);
+      ComplexMatrix Xt(extents[nchol][wb]);
+      ComplexMatrix vHSt(extents[NMO*NMO][wb]);
+      std::fill_n(Xt.data(),Xt.num_elements(),ComplexType(0.));
+      double t0 = cpu_clock();
+      for(int w0=0; w0<nwalk; w0+=wb) {
+        int nw = std::min(wb,nwalk-w0);
+        WalkerContainerRef Wb(Wt.data()+w0*nspin*NMO*NAEA, extents[nw][nspin][NMO][NAEA]);
+        ComplexMatrixRef Wb_data(Wt_data.data()+w0*Wt_data.shape()[1], extents[nw][Wt_data.shape()[1]]);
+        ComplexMatrixRef Gb(Gt.data(), extents[Gt.shape()[0]][nw]);
+        ComplexMatrixRef vbiasb(vbiast.data(), extents[nchol][nw]);
+        ComplexMatrixRef Xb(Xt.data(), extents[nchol][nw]);
+        ComplexMatrixRef vHSb(vHSt.data(), walker_major?extents[nw][NMO*NMO]:extents[NMO*NMO][nw]);
+        AFQMCSys.calculate_mixed_density_matrix(Wb,Wb_data,Gb,transposed_Spvn);
+        if(transposed_Spvn)
+          base::get_vbias(opSpvnT,Gb,vbiasb,true);  
+        else
+          base::get_vbias(opSpvn,Gb,vbiasb,false);
+        if(walker_major)
+          base::get_vHS_walker_major(opSpvn,Xb,vHSb);      
+        else
+          base::get_vHS(opSpvn,Xb,vHSb);      
+        if(merged_propg)
+          AFQMCSys.propagate_merged(Wb,opPropg2,vHSb,walker_major);
+        else
+          AFQMCSys.propagate(Wb,opPropg1,vHSb,walker_major);
+      }
+      return cpu_clock()-t0;
+    };
+    std::cout<<"\n  Autotuning walker block size and vHS layout (block:layout  time per substep (s)): \n";
+    std::vector<bool> layouts;
+    if(user_layout) 
+      layouts.push_back(walker_major_vHS);
+    else
+      layouts = {true,false};
+    afqmc::TunedPipeline pipeline = afqmc::tune_pipeline(nwalk,cache_block,user_walker_block?walker_block:0,
+                                                         layouts,time_pass,std::cout);
+    // the buffers of the tuner are released, their addresses must not hit the density matrix cache 
+    AFQMCSys.invalidate_density_matrix();
+    walker_block = pipeline.walker_block;
+    walker_major_vHS = pipeline.walker_major;
+    afqmc::TuningDatabase::params_type params;
+    params["walker_block"] = std::to_string(walker_block);
+    params["vHS_layout"] = pipeline.layout();
+    tuning_db.store(machine_sig,problem_sig,params);
+    if(!tuning_db.save(tuning_file))
+      std::cerr<<" Warning: Problems writing tuning database: " <<tuning_file <<std::endl;
+    tuned_pipeline = true;
+  }
+  bool tiled = (walker_block < nwalk);
 
   std::cout<<"\n";
   std::cout<<"***********************************************************\n";
@@ -207,19 +569,68 @@ int main(int argc, char **argv)
            <<"    verbose: " <<std::boolalpha <<verbose <<"\n"
            <<"    # Chol Vectors: " <<nchol <<"\n"
            <<"    transposed Spvn: " <<transposed_Spvn <<"\n"
+           <<"    vHS layout: " <<(walker_major_vHS?"walker":"orbital") <<"\n"
+           <<"    one-body half-steps: " <<(merged_propg?"merged":"split") <<"\n"
+           <<"    closed shell (one spin per walker): " <<closed_shell <<"\n"
+           <<"    compact sparse matrices: " <<compact_sparse <<"\n"
+           <<"    hardware counters: " <<(hw_counters?std::to_string(hw_counters_available)
+                                        +" of "+std::to_string(int(PerfCounters::num_counters))+" available":"off") <<"\n"
            <<"    Chol. Matrix Sparsity: " <<Spvn.size()/double(nchol*NMO*NMO) <<"\n"
            <<"    Hamiltonian Sparsity: " <<Vakbl.size()/double(NAEA*NAEA*NMO*NMO*4.0) <<std::endl;
-
-  ComplexMatrix vbias(extents[nchol][nwalk]);     // bias potential
-  ComplexMatrix vHS(extents[NMO*NMO][nwalk]);        // Hubbard-Stratonovich potential
-  ComplexMatrix G(extents[NIK][nwalk]);           // density matrix
+  if(compact_sparse)
+    std::cout<<"    Memory reclaimed by compact sparse matrices: " <<reclaimed/1024.0/1024.0 <<" MB\n";
+  if(tuned)
+    std::cout<<"    storage formats from tuning database: " <<tuning_file <<"\n";
+  else
+    std::cout<<"    dense storage: " <<dense_mode <<"\n";
+  if(tuned_pipeline)
+    std::cout<<"    walker block size and vHS layout from tuning database: " <<tuning_file <<"\n";
+  auto print_storage = [&](const std::string& name, const ComplexMatStorage& S, const afqmc::TunedFormat& f,
+                           double fill, double ratio) {
+    std::cout<<"    " <<name <<" storage: " <<S.format();
+    if(S.format() == "bsr")
+      std::cout<<", block size: " <<S.block_size() <<", block fill: " <<fill;
+    else if(S.format() == "sell")
+      std::cout<<", slice height: " <<S.block_size() <<", sort window: " <<sell_sigma*S.block_size() <<", fill: " <<fill;
+    else if(S.format() == "dcsr")
+      std::cout<<", bytes saved per non-zero against compact csr: " <<fill <<" (" <<S.explicit_zeros() 
+               <<" explicit zeros, the csr matrix is kept)";
+    else if(f.format == "bsr")
+      std::cout<<" (bsr block fill: " <<fill <<")";
+    if(!tuned && dense_mode != "no")
+      std::cout<<" (predicted dense/sparse time: " <<ratio <<")";
+    std::cout<<"\n";
+  };
+  print_storage("Spvn",stSpvn,fmt_Spvn,fill_Spvn,dense_ratio_Spvn);
+  if(transposed_Spvn)
+    print_storage("SpvnT",stSpvnT,fmt_SpvnT,fill_SpvnT,dense_ratio_SpvnT);
+  print_storage("Vakbl",stVakbl,fmt_Vakbl,fill_Vakbl,dense_ratio_Vakbl);
+  auto print_propagator = [&](const std::string& name, const PropgStorage& p) {
+    std::cout<<"    " <<name <<" storage: " <<p.op.format();
+    if(propg_cutoff >= 0.0)
+      std::cout<<", cutoff: " <<propg_cutoff <<", sparsity: " <<p.sparsity <<", largest dropped element: " <<p.err_max
+               <<", norm of dropped elements: " <<p.err_fro <<" (predicted dense/sparse time: " <<p.ratio <<")";
+    std::cout<<"\n";
+  };
+  print_propagator("Propg1",stPropg1);
+  if(merged_propg)
+    print_propagator("Propg2",stPropg2);
+
+
+  std::cout<<"    walker block size: " <<walker_block <<"\n";
+
+  ComplexMatrix vbias(extents[nchol][walker_block]);     // bias potential
+  ComplexMatrix vHS(extents[NMO*NMO][walker_block]);        // Hubbard-Stratonovich potential
+  ComplexMatrix G(extents[transposed_Spvn?0:NIKs][walker_block]);           // density matrix
   ComplexMatrix Gc(extents[NAK][nwalk]);           // compact density matrix for energy evaluation
+  ComplexMatrix Gc_block(extents[tiled?NAKs:0][walker_block]);   // compact density matrix of a block of walkers 
   ComplexMatrix X(extents[nchol][nwalk]);         // X(n,nw) = rand(n,nw) ( + vbias(n,nw)) 
+  ComplexMatrix X_block(extents[tiled?nchol:0][walker_block]);  // X of a block of walkers
 
   ComplexVector hybridW(extents[nwalk]);         // stores weight factors
   ComplexVector eloc(extents[nwalk]);         // stores local energies
 
-  WalkerContainer W(extents[nwalk][2][NMO][NAEA]);
+  WalkerContainer W(extents[nwalk][nspin][NMO][NAEA]);
   // 0: eloc, 1: weight, 2: ovlp_up, 3: ovlp_down, 4: w_eloc, 5: old_w_eloc, 6: old_ovlp_alpha, 7: old_ovlp_beta
   ComplexMatrix W_data(extents[nwalk][8]);  
   // initialize walkers to trial wave function
@@ -228,16 +639,55 @@ int main(int argc, char **argv)
       for(int na=0; na<NAEA; na++) {
         using std::conj;
         W[n][0][nm][na] = conj(AFQMCSys.trialwfn_alpha[nm][na]);
-        W[n][1][nm][na] = conj(AFQMCSys.trialwfn_beta[nm][na]);
+        if(nspin == 2) W[n][1][nm][na] = conj(AFQMCSys.trialwfn_beta[nm][na]);
       }
 
   // set weights to 1
   for(int n=0; n<nwalk; n++) 
     W_data[n][1] = ComplexType(1.);
 
+  // merged one-body half-steps: W holds Propg1^{-1} * W(full step), the walkers are importance sampled
+  // with the overlaps of W with the trial wave function, i.e. with guiding function Propg1^{-H} * trial.
+  // The full step is recovered in Wm at measurements, with weights corrected by the ratio of overlaps.
+  WalkerContainer Wm(extents[merged_propg?nwalk:0][nspin][NMO][NAEA]);
+  ComplexMatrix W_data_m(extents[merged_propg?nwalk:0][8]);  
+
+  // walkers with zero weight are removed from the walker set after every substep, 
+  // so that the kernels only see the live walkers, W[0:nlive] and W_data[0:nlive]. 
+  // walker_id holds the original index of the live walkers, which selects their random numbers. 
+  int nlive = nwalk;
+  std::vector<int> walker_id(nwalk);
+  std::iota(walker_id.begin(),walker_id.end(),0);
+
+  // cost of measure_energy, registered with Timer_eloc 
+  auto measure_energy_cost = [&]() {
+    afqmc::KernelCost c = afqmc::density_matrix_cost(NMO,NAEA,nspin,nlive,true);
+    c += afqmc::energy_cost(opVakbl,nlive);
+    if(merged_propg) c += afqmc::product_cost(opPropg1,nspin*nlive*NAEA);
+    return c;
+  };
+  auto measure_energy = [&]() {
+    WalkerContainerRef Wl(W.data(), extents[nlive][nspin][NMO][NAEA]);
+    ComplexMatrixRef W_datal(W_data.data(), extents[nlive][W_data.shape()[1]]);
+    ComplexMatrixRef Gcl(Gc.data(), extents[NAK][nlive]);
+    if(!merged_propg) {
+      AFQMCSys.calculate_mixed_density_matrix(Wl,W_datal,Gcl,true);
+      return AFQMCSys.calculate_energy(W_datal,Gcl,haj,opVakbl);
+    }
+    WalkerContainerRef Wml(Wm.data(), extents[nlive][nspin][NMO][NAEA]);
+    ComplexMatrixRef W_data_ml(W_data_m.data(), extents[nlive][W_data_m.shape()[1]]);
+    AFQMCSys.split_half_step(Wl,opPropg1,Wml);
+    AFQMCSys.calculate_mixed_density_matrix(Wml,W_data_ml,Gcl,true);
+    for(int nw=0; nw<nlive; nw++) {
+      ComplexType ratio = W_data_ml[nw][2]*W_data_ml[nw][3]/(W_datal[nw][2]*W_datal[nw][3]);
+      W_data_ml[nw][1] = W_datal[nw][1]*ratio.real();
+    }
+    return AFQMCSys.calculate_energy(W_data_ml,Gcl,haj,opVakbl);
+  };
+
   // initialize overlaps and energy
-  AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
-  RealType Eav = AFQMCSys.calculate_energy(W_data,Gc,haj,Vakbl);
+  if(merged_propg) AFQMCSys.calculate_overlaps(W,W_data);
+  RealType Eav = measure_energy();
   
   std::cout<<"\n";
   std::cout<<"***********************************************************\n";
@@ -245,77 +695,193 @@ int main(int argc, char **argv)
   std::cout<<"***********************************************************\n\n";
   std::cout<<"# Step   Energy   \n";
 
+  if(trace_file != "") TimerManager.enable_trace(trace_capacity);
+  bool benchmark_mode = (baseline_out != "" || baseline_in != "");
+  // walkers and results of the stages of the substep recorded with -S
+  afqmc::SubstepRecord snapshot;
+  snapshot.merged_propg = merged_propg;
+  snapshot.propg_cutoff = propg_cutoff;
+  snapshot.sparse_propg1 = !opPropg1.is_dense();
+  snapshot.sparse_propg2 = merged_propg && !opPropg2.is_dense();
+  snapshot.init_file = init_file;
+  snapshot.synthetic_spec = synthetic_spec;
+  // per-step telemetry: the time of every stage during the step, from the difference of the timers
+  afqmc::TelemetryStream telemetry;
+  std::vector<int> telemetry_timers;
+  std::vector<std::string> telemetry_names;
+  for(int i=0; i<MiniQMCTimerNames.size(); i++) 
+    if(MiniQMCTimerNames[i].id != Timer_Total) {
+      telemetry_timers.push_back(MiniQMCTimerNames[i].id);
+      telemetry_names.push_back(MiniQMCTimerNames[i].name);
+    }
+  std::vector<double> stage_start(telemetry_timers.size(),0.0), stage_times(telemetry_timers.size(),0.0);
+  if(telemetry_file != "" && !telemetry.open(telemetry_file,telemetry_names))
+    std::cerr<<" Warning: Problems opening telemetry file: " <<telemetry_file <<std::endl;
+  double walker_substeps = 0.0;   // live walkers propagated, summed over substeps
+  double t_start = cpu_clock();
   Timers[Timer_Total]->start();
   for(int step = 0, step_tot=0; step < nsteps; step++) {
+
+    double t_step = cpu_clock();
   
     for(int substep = 0; substep < nsubsteps; substep++, step_tot++) {
 
-      // propagate walker forward 
-      
-      // 1. calculate density matrix and bias potential 
-      
-      if(transposed_Spvn) {
+      TimerManager.set_trace_step(step,substep);
+      walker_substeps += nlive;
 
-        Timers[Timer_DMc]->start();
-        AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
-        Timers[Timer_DMc]->stop();
+      // propagate walker forward, one block of walkers at a time 
 
-        Timers[Timer_vbias]->start();
-        base::get_vbias(SpvnT,Gc,vbias,true);  
-        Timers[Timer_vbias]->stop();
-  
-      } else {
+      WalkerContainerRef Wl(W.data(), extents[nlive][nspin][NMO][NAEA]);
+      ComplexMatrixRef W_datal(W_data.data(), extents[nlive][W_data.shape()[1]]);
+      ComplexMatrixRef Gcl(Gc.data(), extents[NAK][nlive]);
 
-        Timers[Timer_DM]->start();
-        AFQMCSys.calculate_mixed_density_matrix(W,W_data,G,false); 
-        Timers[Timer_DM]->stop();
+      // the compact density matrix of all walkers from the last measurement is still valid 
+      bool Gc_current = tiled && transposed_Spvn && AFQMCSys.density_matrix_is_cached(Wl,W_datal,Gcl,true);
 
-        Timers[Timer_vbias]->start();
-        base::get_vbias(Spvn,G,vbias,false);
-        Timers[Timer_vbias]->stop();
-
-      } 
-
-      // 2. calculate X and weight
-      //  X(chol,nw) = rand + i*vbias(chol,nw)
+      // random numbers are generated for all walkers, to be independent of the block size 
       Timers[Timer_X]->start();
       random_th.generate_normal(X.data(),X.num_elements()); 
       std::fill(hybridW.begin(),hybridW.end(),ComplexType(0.)); 
-      for(int n=0; n<nchol; n++)
-        for(int nw=0; nw<nwalk; nw++) { 
-          hybridW[nw] -= im*vbias[n][nw]*(X[n][nw]+halfim*vbias[n][nw]);
-          X[n][nw] += im*vbias[n][nw];
-        }
       Timers[Timer_X]->stop();
 
-      // 3. calculate vHS
-      // vHS(i,k,nw) = sum_n Spvn(i,k,n) * X(n,nw) 
-      Timers[Timer_vHS]->start();
-      base::get_vHS(Spvn,X,vHS);      
-      Timers[Timer_vHS]->stop();
+      bool record_substep = (snapshot_file != "" && step == snapshot_step && substep == snapshot_substep);
+      if(record_substep) {
+        snapshot.setup(NMO,NAEA,nspin,nchol,nlive,transposed_Spvn,walker_major_vHS);
+        snapshot.step = step;
+        snapshot.substep = substep;
+        snapshot.W = Wl;
+        snapshot.W_data = W_datal;
+      }
 
-      // 4. propagate walker
-      // W(new) = Propg1 * exp(vHS) * Propg1 * W(old)
-      Timers[Timer_Propg]->start();
-      AFQMCSys.propagate(W,Propg1,vHS);
-      Timers[Timer_Propg]->stop();
+      for(int w0=0; w0<nlive; w0+=walker_block) {
+
+        int nw = std::min(walker_block,nlive-w0);
+        WalkerContainerRef Wb(W.data()+w0*nspin*NMO*NAEA, extents[nw][nspin][NMO][NAEA]);
+        ComplexMatrixRef Wb_data(W_data.data()+w0*W_data.shape()[1], extents[nw][W_data.shape()[1]]);
+        ComplexMatrixRef Gcb((tiled?Gc_block:Gc).data(), extents[NAKs][nw]);
+        ComplexMatrixRef Gb(G.data(), extents[G.shape()[0]][nw]);
+        ComplexMatrixRef vbiasb(vbias.data(), extents[nchol][nw]);
+        ComplexMatrixRef Xb((tiled?X_block:X).data(), extents[nchol][nw]);
+        ComplexMatrixRef vHSb(vHS.data(), walker_major_vHS?extents[nw][NMO*NMO]:extents[NMO*NMO][nw]);
+
+        // 1. calculate density matrix and bias potential 
+      
+        if(transposed_Spvn) {
+
+          Timers[Timer_DMc]->start();
+          if(Gc_current) {
+            for(int i=0; i<NAKs; i++)
+              for(int n=0; n<nw; n++)
+                Gcb[i][n] = Gcl[i][w0+n];
+          } else {
+            AFQMCSys.calculate_mixed_density_matrix(Wb,Wb_data,Gcb,true);
+            afqmc::KernelCost c = afqmc::density_matrix_cost(NMO,NAEA,nspin,nw,true);
+            Timers[Timer_DMc]->add_work(c.flops,c.bytes);
+          }
+          Timers[Timer_DMc]->stop();
+
+          Timers[Timer_vbias]->start();
+          base::get_vbias(opSpvnT,Gcb,vbiasb,true);  
+          Timers[Timer_vbias]->stop();
+          afqmc::KernelCost c = afqmc::product_cost(opSpvnT,nw);
+          Timers[Timer_vbias]->add_work(c.flops,c.bytes);
+  
+        } else {
+
+          Timers[Timer_DM]->start();
+          AFQMCSys.calculate_mixed_density_matrix(Wb,Wb_data,Gb,false); 
+          Timers[Timer_DM]->stop();
+          afqmc::KernelCost c = afqmc::density_matrix_cost(NMO,NAEA,nspin,nw,false);
+          Timers[Timer_DM]->add_work(c.flops,c.bytes);
+
+          Timers[Timer_vbias]->start();
+          base::get_vbias(opSpvn,Gb,vbiasb,false);
+          Timers[Timer_vbias]->stop();
+          c = afqmc::product_cost(opSpvn,nw);
+          Timers[Timer_vbias]->add_work(c.flops,c.bytes);
+
+        } 
+        if(record_substep) {
+          if(transposed_Spvn)
+            afqmc::SubstepRecord::copy_columns(Gcb,snapshot.G,w0);
+          else
+            afqmc::SubstepRecord::copy_columns(Gb,snapshot.G,w0);
+          afqmc::SubstepRecord::copy_columns(vbiasb,snapshot.vbias,w0);
+        }
+
+        // 2. calculate X and weight
+        //  X(chol,nw) = rand + i*vbias(chol,nw)
+        Timers[Timer_X]->start();
+        for(int n=0; n<nchol; n++)
+          for(int iw=0; iw<nw; iw++) { 
+            Xb[n][iw] = X[n][walker_id[w0+iw]];
+            hybridW[w0+iw] -= im*vbiasb[n][iw]*(Xb[n][iw]+halfim*vbiasb[n][iw]);
+            Xb[n][iw] += im*vbiasb[n][iw];
+          }
+        Timers[Timer_X]->stop();
+        if(record_substep)
+          afqmc::SubstepRecord::copy_columns(Xb,snapshot.X,w0);
+
+        // 3. calculate vHS
+        // vHS(i,k,nw) = sum_n Spvn(i,k,n) * X(n,nw) 
+        Timers[Timer_vHS]->start();
+        if(walker_major_vHS)
+          base::get_vHS_walker_major(opSpvn,Xb,vHSb);      
+        else
+          base::get_vHS(opSpvn,Xb,vHSb);      
+        Timers[Timer_vHS]->stop();
+        afqmc::KernelCost cvHS = afqmc::product_cost(opSpvn,nw);
+        Timers[Timer_vHS]->add_work(cvHS.flops,cvHS.bytes);
+        if(record_substep) {
+          if(walker_major_vHS)
+            afqmc::SubstepRecord::copy_rows(vHSb,snapshot.vHS,w0);
+          else
+            afqmc::SubstepRecord::copy_columns(vHSb,snapshot.vHS,w0);
+        }
+
+        // 4. propagate walker
+        // W(new) = Propg1 * exp(vHS) * Propg1 * W(old)
+        // or, with merged half-steps, W(new) = exp(vHS) * Propg1 * Propg1 * W(old)
+        Timers[Timer_Propg]->start();
+        if(merged_propg)
+          AFQMCSys.propagate_merged(Wb,opPropg2,vHSb,walker_major_vHS);
+        else
+          AFQMCSys.propagate(Wb,opPropg1,vHSb,walker_major_vHS);
+        Timers[Timer_Propg]->stop();
+        afqmc::KernelCost cPropg = merged_propg?
+                afqmc::propagation_cost<ComplexMatOp>(nullptr,opPropg2,NMO,NAEA,nspin,nw):
+                afqmc::propagation_cost(&opPropg1,opPropg1,NMO,NAEA,nspin,nw);
+        Timers[Timer_Propg]->add_work(cPropg.flops,cPropg.bytes);
+
+      }
 
       // 5. update overlaps
       Timers[Timer_extra]->start();
-      for(int nw=0; nw<nwalk; nw++) {
+      for(int nw=0; nw<nlive; nw++) {
         W_data[nw][5] = W_data[nw][4];
         W_data[nw][6] = W_data[nw][2];
         W_data[nw][7] = W_data[nw][3];
       }
       Timers[Timer_extra]->stop();
       Timers[Timer_ovlp]->start();
-      AFQMCSys.calculate_overlaps(W,W_data);
+      AFQMCSys.calculate_overlaps(Wl,W_datal);
       Timers[Timer_ovlp]->stop();
+      afqmc::KernelCost cOvlp = afqmc::overlap_cost(NMO,NAEA,nspin,nlive);
+      Timers[Timer_ovlp]->add_work(cOvlp.flops,cOvlp.bytes);
+
+      if(record_substep) {
+        snapshot.W_out = Wl;
+        snapshot.W_data_out = W_datal;
+        if(snapshot.write(snapshot_file))
+          std::cout<<"# recorded step " <<step <<", substep " <<substep <<" in " <<snapshot_file <<"\n";
+        else
+          std::cerr<<" Warning: Problems writing substep record: " <<snapshot_file <<std::endl;
+      }
 
       // 6. adjust weights and walker data      
       Timers[Timer_extra]->start();
       RealType et = 0.;
-      for(int nw=0; nw<nwalk; nw++) {
+      for(int nw=0; nw<nlive; nw++) {
         ComplexType ratioOverlaps = W_data[nw][2]*W_data[nw][3]/(W_data[nw][6]*W_data[nw][7] );   
         RealType scale = std::max(0.0,std::cos( std::arg( ratioOverlaps )) );
         W_data[nw][4] = -( hybridW[nw] + std::log(ratioOverlaps) )/dt; 
@@ -324,37 +890,89 @@ int main(int argc, char **argv)
       }
 
       // decide what to do with Eshift later
-      Eshift = et/nwalk;
+      Eshift = et/nlive;
+
+      // 7. remove walkers with zero weight
+      nlive = AFQMCSys.compact_walkers(W,W_data,walker_id,nlive);
+      if(nlive == 0)
+        APP_ABORT(" Error: All walkers have zero weight. \n");
       Timers[Timer_extra]->stop();
 
       if(step_tot > 0 && step_tot%northo == 0) {
+        WalkerContainerRef Wl(W.data(), extents[nlive][nspin][NMO][NAEA]);
+        ComplexMatrixRef W_datal(W_data.data(), extents[nlive][W_data.shape()[1]]);
         Timers[Timer_ortho]->start();
-        AFQMCSys.orthogonalize(W);
+        AFQMCSys.orthogonalize(Wl);
         Timers[Timer_ortho]->stop();
+        afqmc::KernelCost c = afqmc::orthogonalization_cost(NMO,NAEA,nspin,nlive);
+        Timers[Timer_ortho]->add_work(c.flops,c.bytes);
         Timers[Timer_ovlp]->start();
-        AFQMCSys.calculate_overlaps(W,W_data);
+        AFQMCSys.calculate_overlaps(Wl,W_datal);
         Timers[Timer_ovlp]->stop();
+        c = afqmc::overlap_cost(NMO,NAEA,nspin,nlive);
+        Timers[Timer_ovlp]->add_work(c.flops,c.bytes);
       }
        
     }
 
+    // measurements are recorded with substep -1 
+    TimerManager.set_trace_step(step,-1);
     Timers[Timer_eloc]->start();
-    AFQMCSys.calculate_mixed_density_matrix(W,W_data,Gc,true);
-    Eav = AFQMCSys.calculate_energy(W_data,Gc,haj,Vakbl);
+    afqmc::KernelCost cEloc = measure_energy_cost();
+    Eav = measure_energy();
     std::cout<<step <<"   " <<Eav <<"\n";
+    if(verbose && nlive < nwalk) 
+      std::cout<<"# live walkers: " <<nlive <<"\n";
     Timers[Timer_eloc]->stop();
+    Timers[Timer_eloc]->add_work(cEloc.flops,cEloc.bytes);
+
+    if(telemetry.is_open()) {
+      double t_now = cpu_clock();
+      for(int i=0; i<telemetry_timers.size(); i++) {
+        double t = Timers[telemetry_timers[i]]->get_total();
+        stage_times[i] = t-stage_start[i];
+        stage_start[i] = t;
+      }
+      telemetry.write(step,t_now-t_start,t_now-t_step,Eav,afqmc::walker_statistics(W_data,nlive,nwalk),stage_times);
+    }
+
+    // one sample of every stage per step, the first step is a warm-up
+    if(benchmark_mode) TimerManager.collect_samples(step > 0);
 
     // Branching in real code would happen here!!!
   
   }    
   Timers[Timer_Total]->stop();
+  double throughput = walker_substeps/(cpu_clock()-t_start);
 
   std::cout<<"\n";
   std::cout<<"***********************************************************\n";
   std::cout<<"                   Finished Calculation                    \n";   
   std::cout<<"***********************************************************\n\n";
   
+  if(calibrate_peak) 
+    TimerManager.set_machine_peak(afqmc::measure_gemm_peak(),afqmc::measure_stream_bandwidth());
   TimerManager.print();
+  if(trace_file != "" && !TimerManager.write_trace(trace_file))
+    std::cerr<<" Warning: Problems writing event trace: " <<trace_file <<std::endl;
+
+  std::cout<<"\n  Throughput: " <<throughput <<" walker substeps per second (walker block size: " <<walker_block <<")\n";
+  std::cout<<"  Density matrix evaluations reused from the cache: " <<AFQMCSys.density_matrix_cache_hits()
+           <<", estimated time saved: " <<AFQMCSys.density_matrix_cache_time_saved() <<" s\n";
+
+  if(baseline_out != "" && !TimerManager.write_samples(baseline_out))
+    std::cerr<<" Warning: Problems writing timer baseline: " <<baseline_out <<std::endl;
+  if(baseline_in != "") {
+    int nregressions = TimerManager.compare_samples(baseline_in,regression_threshold);
+    if(nregressions < 0) {
+      std::cerr<<" Error: Problems reading timer baseline: " <<baseline_in <<std::endl;
+      return 1;
+    }
+    if(nregressions > 0) {
+      std::cout<<"\n  Performance regressions: " <<nregressions <<"\n";
+      return 2;
+    }
+  }
 
   return 0;
 }
@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////
+// This file is distributed under the University of Illinois/NCSA Open Source
+// License.  See LICENSE file in top directory for details.
+//
+// Copyright (c) 2016 Jeongnim Kim and QMCPACK developers.
+//
+// File developed by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+//
+// File created by:
+// Miguel A. Morales, moralessilva2@llnl.gov
+//    Lawrence Livermore National Laboratory
+////////////////////////////////////////////////////////////////////////////////
+// -*- C++ -*-
+/** @file spmm_bench.cpp
+    @brief Benchmark of the sparse matrix formats used by the miniapp
+
+    Times the sparse-dense products in get_vHS, get_vbias and calculate_energy
+    with the Cholesky and Hamiltonian matrices stored in csr, bsr and sell format,
+    for an increasing number of walkers.
+ */
+#include <Configuration.h>
+#include <Utilities/Clock.h>
+#include <Utilities/RandomGenerator.h>
+#include <getopt.h>
+#include "io/hdf_archive.h"
+
+#include "AFQMC/afqmc_sys.hpp"
+#include "Matrix/initialize_serial.hpp"
+#include "AFQMC/rotate.hpp"
+#include "Numerics/ma_operations.hpp"
+
+using namespace std;
+using namespace qmcplusplus;
+
+void print_help()
+{
+  printf("spmm_bench - benchmark of sparse matrix formats for the AFQMC miniapp\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("-w                Maximum number of walkers (default: 128)\n");
+  printf("-r                Number of repetitions of each product (default: 10)\n");
+  printf("-b                Block size of bsr format, slice height of sell format (default: 4)\n");
+  printf("-f                Input file name (default: ./afqmc.h5)\n");
+}
+
+// average time per call of C = A*B
+template<class SpMat, class MatA, class MatB>
+double time_product(const SpMat& A, const MatA& B, MatB& C, int nrep)
+{
+  ma::product(A,B,C);
+  double t0 = cpu_clock();
+  for(int i=0; i<nrep; i++)
+    ma::product(A,B,C);
+  return (cpu_clock()-t0)/nrep;
+}
+
+int main(int argc, char **argv)
+{
+
+#ifndef QMC_COMPLEX
+  std::cerr<<" Error: Please compile complex executable, QMC_COMPLEX=1. " <<std::endl;
+  exit(1);
+#endif
+
+  int max_nwalk = 128;
+  int nrep = 10;
+  int block = 4;
+  const int sell_sigma = 32;
+  const double dt = 0.01;
+  std::string init_file = "afqmc.h5";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hw:r:b:f:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h': print_help(); return 1;
+    case 'w':
+      max_nwalk = atoi(optarg);
+      break;
+    case 'r':
+      nrep = atoi(optarg);
+      break;
+    case 'b':
+      block = atoi(optarg);
+      break;
+    case 'f':
+      init_file = std::string(optarg);
+      break;
+    }
+  }
+
+  Random.init(0, 1, 11);
+
+  base::afqmc_sys AFQMCSys;
+  ComplexSpMat Spvn, SpvnT, Vakbl;
+  ComplexMatrix haj, Propg1;
+
+  hdf_archive dump;
+  if(!dump.open(init_file,H5F_ACC_RDONLY))
+    APP_ABORT("Error: problems opening hdf5 file. \n");
+  if(!afqmc::Initialize(dump,dt,AFQMCSys,Propg1,Spvn,haj,Vakbl)) {
+    std::cerr<<" Error initalizing data structures from hdf5 file: " <<init_file <<std::endl;
+    exit(1);
+  }
+  base::halfrotate_cholesky(AFQMCSys.trialwfn_alpha,AFQMCSys.trialwfn_beta,Spvn,SpvnT);
+
+  ComplexBSpMat bsrSpvn, bsrSpvnT, bsrVakbl;
+  ComplexSellSpMat sellSpvn, sellSpvnT, sellVakbl;
+  bsrSpvn.initFrom(Spvn,block);
+  bsrSpvnT.initFrom(SpvnT,block);
+  bsrVakbl.initFrom(Vakbl,block);
+  sellSpvn.initFrom(Spvn,block,sell_sigma*block);
+  sellSpvnT.initFrom(SpvnT,block,sell_sigma*block);
+  sellVakbl.initFrom(Vakbl,block,sell_sigma*block);
+
+  int NMO = AFQMCSys.NMO;
+  int NAEA = AFQMCSys.NAEA;
+  int nchol = Spvn.cols();
+  int NAK = 2*NAEA*NMO;
+
+  std::cout<<"  NMO, NAEA, nchol: " <<NMO <<", " <<NAEA <<", " <<nchol <<"\n"
+           <<"  block size: " <<block <<"\n"
+           <<"  # matrix  nnz  bsr_fill  sell_fill \n"
+           <<"    Spvn  " <<Spvn.size() <<"  " <<bsrSpvn.fill() <<"  " <<sellSpvn.fill() <<"\n"
+           <<"    SpvnT  " <<SpvnT.size() <<"  " <<bsrSpvnT.fill() <<"  " <<sellSpvnT.fill() <<"\n"
+           <<"    Vakbl  " <<Vakbl.size() <<"  " <<bsrVakbl.fill() <<"  " <<sellVakbl.fill() <<"\n\n";
+
+  std::cout<<"# product  nwalk  csr(s)  bsr(s)  sell(s)  bsr/csr  sell/csr \n";
+  for(int nwalk=1; nwalk<=max_nwalk; nwalk*=2) {
+
+    ComplexMatrix X(extents[nchol][nwalk]);
+    ComplexMatrix vHS(extents[NMO*NMO][nwalk]);
+    ComplexMatrix Gc(extents[NAK][nwalk]);
+    ComplexMatrix vbias(extents[nchol][nwalk]);
+    ComplexMatrix Gcloc(extents[NAK][nwalk]);
+    Random.generate_normal(X.data(),X.num_elements());
+    Random.generate_normal(Gc.data(),Gc.num_elements());
+
+    double t[3];
+    t[0] = time_product(Spvn,X,vHS,nrep);
+    t[1] = time_product(bsrSpvn,X,vHS,nrep);
+    t[2] = time_product(sellSpvn,X,vHS,nrep);
+    std::cout<<"vHS  " <<nwalk <<"  " <<t[0] <<"  " <<t[1] <<"  " <<t[2] <<"  " <<t[1]/t[0] <<"  " <<t[2]/t[0] <<"\n";
+
+    t[0] = time_product(SpvnT,Gc,vbias,nrep);
+    t[1] = time_product(bsrSpvnT,Gc,vbias,nrep);
+    t[2] = time_product(sellSpvnT,Gc,vbias,nrep);
+    std::cout<<"vbias  " <<nwalk <<"  " <<t[0] <<"  " <<t[1] <<"  " <<t[2] <<"  " <<t[1]/t[0] <<"  " <<t[2]/t[0] <<"\n";
+
+    t[0] = time_product(Vakbl,Gc,Gcloc,nrep);
+    t[1] = time_product(bsrVakbl,Gc,Gcloc,nrep);
+    t[2] = time_product(sellVakbl,Gc,Gcloc,nrep);
+    std::cout<<"energy  " <<nwalk <<"  " <<t[0] <<"  " <<t[1] <<"  " <<t[2] <<"  " <<t[1]/t[0] <<"  " <<t[2]/t[0] <<"\n";
+  }
+
+  return 0;
+}